@@ -1,1544 +1,7171 @@
-#include <iostream>
-#include <string>
-#include <ctime>
-#include <cstdlib>
-#include <limits> // For numeric_limits
-#include <vector> // For dynamic array for shared files
-
-using namespace std;
-
-// ANSI color codes for console output
-#define RESET   "\033[0m"
-#define RED     "\033[31m"
-#define GREEN   "\033[32m"
-#define YELLOW  "\033[33m"
-#define BLUE    "\033[34m"
-#define MAGENTA "\033[35m"
-#define CYAN    "\033[36m"
-#define WHITE   "\033[37m"
-#define BOLD    "\033[1m"
-
-// Helper function to pause and clear screen
-void pauseAndClear() {
-    cout << "\nPress Enter to continue...";
-    cin.ignore(numeric_limits<streamsize>::max(), '\n'); // Clear buffer before ignoring
-    system("cls"); // For Windows, use "clear" for Linux/macOS
-}
-
-// Structure to store different versions of a file in a doubly linked list
-struct FileVersion
-{
-    string content;     // Content of this version
-    FileVersion* prev;  // Pointer to previous version
-    FileVersion* next;  // Pointer to next version
-
-    // Destructor to deallocate memory for subsequent versions
-    ~FileVersion() {
-        delete next; // Recursively delete next version
-    }
-};
-
-// Structure to store file information
-struct FileNode
-{
-    string name;           // File name
-    string type;           // File type/extension
-    string owner;          // File owner/creator
-    FileVersion* versionHead; // Pointer to version history (linked list)
-    FileNode* next;        // Pointer to next file in directory
-    int priority;          // Priority of the file for heap management
-
-    // Destructor to deallocate memory for versions
-    ~FileNode() {
-        delete versionHead; // Delete the head of the version list, which will recursively delete others
-        // Note: next is handled by the containing linked list (FolderNode::files)
-    }
-
-    // Helper to check if a user has specific permission on this file
-    bool canAccess(const string& userRole, const string& requiredPermission) const {
-        // Owner always has full access
-        if (userRole == owner) { // Assuming owner's username is passed as userRole for simplicity
-            return true;
-        }
-
-        // Basic role-based access control
-        if (userRole == "admin") {
-            return true; // Admin can do anything
-        } else if (userRole == "editor") {
-            return (requiredPermission == "read" || requiredPermission == "write");
-        } else if (userRole == "viewer") {
-            return (requiredPermission == "read");
-        }
-        return false; // Default: no access
-    }
-};
-
-// Structure to store folder information in a tree structure
-struct FolderNode
-{
-    string name;        // Folder name
-    FolderNode* parent;  // Pointer to parent folder
-    FolderNode* child;   // Pointer to first child folder
-    FolderNode* sibling; // Pointer to next sibling folder
-    FileNode* files;     // Pointer to files in this folder
-
-    // Destructor to deallocate memory for children, siblings, and files
-    ~FolderNode() {
-        delete child;    // Recursively delete child folders
-        delete sibling;  // Recursively delete sibling folders
-        // Delete all files in this folder
-        FileNode* currentFile = files;
-        while (currentFile) {
-            FileNode* nextFile = currentFile->next;
-            delete currentFile; // Calls FileNode's destructor
-            currentFile = nextFile;
-        }
-    }
-};
-
-// Structure for file metadata used in hash table
-struct fileData
-{
-    string name;
-    string type;
-    string owner;
-    string date;
-    int size;
-    fileData* next;  // For hash table chaining
-
-    // Destructor (optional, but good practice for linked structures)
-    ~fileData() {
-        delete next;
-    }
-};
-
-// Structure for deleted files using stack implementation
-struct DeletedFile
-{
-    string name;
-    string content;
-    time_t deletionTime; // Timestamp for auto-deletion
-    DeletedFile* next;  // Pointer to next deleted file in stack
-
-    // Destructor
-    ~DeletedFile() {
-        delete next;
-    }
-};
-
-// Structure for recent files using queue implementation
-struct RecentFile
-{
-    string name;
-    RecentFile* next;  // Pointer to next recent file in queue
-
-    // Destructor
-    ~RecentFile() {
-        delete next;
-    }
-};
-
-// Structure for user authentication using linked list
-struct UserNode {
-    string username;
-    string password;
-    string role; // Admin, Editor, Viewer
-    string securityAnswer; // For password recovery
-    string lastLogout;     // Timestamp of last logout
-    UserNode* next;       // Pointer to next user
-
-    // Destructor
-    ~UserNode() {
-        delete next;
-    }
-};
-
-// Structure for graph-based user connections (simplified adjacency list using vector)
-struct UserGraphNode {
-    string username;
-    // Stores tuples of (receiver_username, filename, permission)
-    vector<tuple<string, string, string>> sharedFiles;
-    UserGraphNode* next;
-
-    // Destructor
-    ~UserGraphNode() {
-        delete next;
-    }
-};
-
-// Heap structure for managing file priorities (Max-Heap)
-class FilePriorityHeap {
-private:
-    FileNode** heapArray;
-    int capacity;
-    int size;
-
-    void heapifyUp(int index) {
-        while (index > 0 && heapArray[index]->priority > heapArray[(index - 1) / 2]->priority) {
-            swap(heapArray[index], heapArray[(index - 1) / 2]);
-            index = (index - 1) / 2;
-        }
-    }
-
-    void heapifyDown(int index) {
-        int leftChild, rightChild, largestChild;
-        while (true) {
-            leftChild = 2 * index + 1;
-            rightChild = 2 * index + 2;
-            largestChild = index;
-
-            if (leftChild < size && heapArray[leftChild]->priority > heapArray[largestChild]->priority) {
-                largestChild = leftChild;
-            }
-
-            if (rightChild < size && heapArray[rightChild]->priority > heapArray[largestChild]->priority) {
-                largestChild = rightChild;
-            }
-
-            if (largestChild == index) {
-                break;
-            }
-
-            swap(heapArray[index], heapArray[largestChild]);
-            index = largestChild;
-        }
-    }
-
-public:
-    FilePriorityHeap(int cap) : capacity(cap), size(0) {
-        heapArray = new FileNode * [capacity];
-    }
-
-    ~FilePriorityHeap() {
-        // Heap itself holds pointers, actual FileNode objects are owned by FolderNode
-        delete[] heapArray;
-    }
-
-    void insert(FileNode* file) {
-        if (size == capacity) {
-            cout << RED << "Heap is full. Cannot insert more files." << RESET << endl;
-            return;
-        }
-        heapArray[size] = file;
-        heapifyUp(size);
-        size++;
-        cout << GREEN << "File added to priority heap." << RESET << endl;
-    }
-
-    FileNode* extractMax() {
-        if (size == 0) {
-            cout << RED << "Heap is empty." << RESET << endl;
-            return nullptr;
-        }
-        FileNode* max = heapArray[0];
-        heapArray[0] = heapArray[size - 1];
-        size--;
-        heapifyDown(0);
-        return max;
-    }
-
-    void display() {
-        if (size == 0) {
-            cout << RED << "Heap is empty." << RESET << endl;
-            return;
-        }
-        cout << CYAN << "Files in Heap by Priority (Max Priority First):" << RESET << endl;
-        // Displaying elements from the heapArray for inspection
-        for (int i = 0; i < size; i++) {
-            cout << YELLOW << heapArray[i]->name << " (Priority: " << heapArray[i]->priority << ")" << RESET << endl;
-        }
-    }
-};
-
-// Hash Table class for storing file metadata
-class HashTable {
-public:
-    fileData* table[100];  // Array of pointers to file metadata
-
-    // Constructor to initialize hash table
-    HashTable()
-    {
-        for (int i = 0; i < 100; i++)
-        {
-            table[i] = nullptr;
-        }
-    }
-
-    // Destructor to clean up chained lists
-    ~HashTable() {
-        for (int i = 0; i < 100; i++) {
-            delete table[i]; // Calls fileData's destructor recursively
-        }
-    }
-
-    // Simple hash function that sums ASCII values of the key
-    int hashFunction(string key)
-    {
-        size_t h = 0;
-        for (char c : key)
-        {
-            h += c;
-        }
-        return static_cast<int>(h % 100);
-    }
-
-    // Insert new file metadata into hash table
-    void insert(string key, string type, int size, string owner, string date)
-    {
-        int index = hashFunction(key);
-        // Check for duplication before inserting
-        fileData* curr = table[index];
-        while(curr) {
-            if (curr->name == key) {
-                cout << YELLOW << "Metadata for '" << key << "' already exists. Updating it." << RESET << endl;
-                curr->type = type;
-                curr->owner = owner;
-                curr->date = date;
-                curr->size = size;
-                return;
-            }
-            curr = curr->next;
-        }
-
-        fileData* node = new fileData{ key, type, owner, date, size, nullptr };
-
-        if (!table[index])
-        {
-            table[index] = node;
-        }
-        else
-        {
-            fileData* temp = table[index];
-            while (temp->next)
-            {
-                temp = temp->next;
-            }
-            temp->next = node;
-        }
-        cout << GREEN << "Metadata for '" << key << "' inserted." << RESET << endl;
-    }
-
-    // Search for file metadata by name
-    fileData* search(string key)
-    {
-        int index = hashFunction(key);
-        fileData* curr = table[index];
-        while (curr)
-        {
-            if (curr->name == key)
-            {
-                return curr;
-            }
-            curr = curr->next;
-        }
-        return nullptr;
-    }
-
-    // Remove file metadata from hash table
-    void remove(string key) {
-        int index = hashFunction(key);
-        fileData* curr = table[index];
-        fileData* prev = nullptr;
-        while (curr) {
-            if (curr->name == key) {
-                if (prev) {
-                    prev->next = curr->next;
-                } else {
-                    table[index] = curr->next;
-                }
-                curr->next = nullptr; // Detach from the list before deleting
-                delete curr;
-                cout << GREEN << "Metadata for '" << key << "' removed." << RESET << endl;
-                return;
-            }
-            prev = curr;
-            curr = curr->next;
-        }
-        cout << RED << "Metadata for '" << key << "' not found." << RESET << endl;
-    }
-};
-
-// Recycle Bin class using stack implementation
-class RecycleBin
-{
-public:
-    DeletedFile* top;  // Pointer to top of stack
-    const int AUTO_DELETE_TIME_SECONDS = 60 * 60 * 24 * 7; // 7 days in seconds for auto-deletion example
-
-    // Constructor to initialize recycle bin
-    RecycleBin()
-    {
-        top = nullptr;
-    }
-
-    // Destructor to clean up deleted files
-    ~RecycleBin() {
-        delete top; // Recursively deletes all DeletedFile nodes
-    }
-
-    // Push a deleted file onto the stack
-    void push(string name, string content)
-    {
-        top = new DeletedFile{ name, content, time(0), top };
-        cout << GREEN << "File '" << name << "' moved to Recycle Bin." << RESET << endl;
-        cleanUpOldFiles(); // Call cleanup after each push or periodically
-    }
-
-    // View the most recently deleted file
-    void viewTop() {
-        if (!top)
-        {
-            cout << RED << "Recycle Bin is empty" << RESET << endl;
-        }
-        else
-        {
-            cout << GREEN << "Last Deleted File: " << top->name << " (Content: " << top->content << ")" << RESET << endl;
-        }
-    }
-
-    // Pop (restore) the most recently deleted file
-    DeletedFile* pop() {
-        if (!top) {
-            cout << RED << "Recycle Bin is empty. Nothing to restore." << RESET << endl;
-            return nullptr;
-        }
-        DeletedFile* restoredFile = top;
-        top = top->next;
-        restoredFile->next = nullptr; // Detach from stack
-        cout << GREEN << "File '" << restoredFile->name << "' restored from Recycle Bin." << RESET << endl;
-        return restoredFile;
-    }
-
-    // Clean up files older than AUTO_DELETE_TIME_SECONDS
-    void cleanUpOldFiles() {
-        time_t currentTime = time(0);
-        DeletedFile* current = top;
-        DeletedFile* prev = nullptr;
-
-        while (current) {
-            if (difftime(currentTime, current->deletionTime) > AUTO_DELETE_TIME_SECONDS) {
-                // This file is old, delete it
-                if (prev) {
-                    prev->next = current->next;
-                    current->next = nullptr; // Detach
-                    delete current;
-                    current = prev->next;
-                } else { // If current is the top
-                    top = current->next;
-                    current->next = nullptr; // Detach
-                    delete current;
-                    current = top;
-                }
-                cout << YELLOW << "Old file automatically deleted from Recycle Bin." << RESET << endl;
-            } else {
-                prev = current;
-                current = current->next;
-            }
-        }
-    }
-
-    void displayAll() {
-        if (!top) {
-            cout << RED << "Recycle Bin is empty." << RESET << endl;
-            return;
-        }
-        cout << CYAN << "Files in Recycle Bin (Most Recent First):" << RESET << endl;
-        DeletedFile* temp = top;
-        while (temp) {
-            char dt[26];
-            ctime_s(dt, sizeof(dt), &temp->deletionTime);
-            string timeStr(dt);
-            cout << YELLOW << "Name: " << temp->name << ", Deletion Time: " << timeStr.substr(0, timeStr.length() - 1) << RESET << endl;
-            temp = temp->next;
-        }
-    }
-};
-
-// Recent Files queue using FIFO implementation (modified for LRU)
-class FileQueue
-{
-public:
-    RecentFile* front;  // Front of queue
-    RecentFile* rear;   // Rear of queue
-    int size, capacity; // Current size and max capacity
-
-    // Constructor to initialize recent files queue
-    FileQueue(int cap = 5)
-    {
-        front = rear = nullptr;
-        size = 0;
-        capacity = cap;
-    }
-
-    // Destructor to clean up recent files
-    ~FileQueue() {
-        delete front; // Recursively deletes all RecentFile nodes
-    }
-
-    // Add file to end of queue (LRU logic: move to rear if already exists)
-    void enqueue(string name)
-    {
-        // Check if file already exists in queue (for LRU logic)
-        RecentFile* current = front;
-        RecentFile* prev = nullptr;
-        while (current) {
-            if (current->name == name) {
-                // File found, move it to the end (most recently used)
-                if (prev) {
-                    prev->next = current->next;
-                    if (current == rear) { // If it was the rear, prev becomes new rear
-                        rear = prev;
-                    }
-                } else { // If it was the front
-                    front = current->next;
-                    if (!front) { // If it was the only element
-                        rear = nullptr;
-                    }
-                }
-                // Now, add it to the end
-                if (!rear) {
-                    front = rear = current;
-                } else {
-                    rear->next = current;
-                    rear = current;
-                }
-                current->next = nullptr; // Ensure detached
-                cout << YELLOW << "File '" << name << "' moved to end of Recent Files (LRU)." << RESET << endl;
-                return;
-            }
-            prev = current;
-            current = current->next;
-        }
-
-        // File not found, add new
-        if (size == capacity)
-        {
-            dequeue(); // Remove the least recently used
-        }
-        RecentFile* file = new RecentFile{ name, nullptr };
-        if (!rear)
-        {
-            front = rear = file;
-        }
-        else
-        {
-            rear->next = file;
-            rear = file;
-        }
-        size++;
-        cout << GREEN << "File '" << name << "' added to Recent Files." << RESET << endl;
-    }
-
-    // Remove file from front of queue (least recently used)
-    void dequeue()
-    {
-        if (!front)
-        {
-            return;
-        }
-        RecentFile* temp = front;
-        front = front->next;
-        temp->next = nullptr; // Detach
-        delete temp;
-        size--;
-        if (!front)
-        {
-            rear = nullptr;
-        }
-    }
-
-    // Display all recent files
-    void display()
-    {
-        if (!front)
-        {
-            cout << RED << "No recent files." << RESET << endl;
-        }
-        else
-        {
-            cout << CYAN << "Recent Files (Least Recent to Most Recent):" << RESET << endl;
-            RecentFile* temp = front;
-            while (temp)
-            {
-                cout << YELLOW << temp->name << RESET << endl;
-                temp = temp->next;
-            }
-        }
-    }
-};
-
-// User Authentication system using linked list
-class UserAuth
-{
-public:
-    UserNode* head;  // Pointer to first user
-
-    // Constructor to initialize user authentication system
-    UserAuth()
-    {
-        head = nullptr;
-    }
-
-    // Destructor to clean up user nodes
-    ~UserAuth() {
-        delete head; // Recursively deletes all UserNode nodes
-    }
-
-    // Register a new user
-    void signup(string username, string password, string role, string secAns)
-    {
-        UserNode* curr = head;
-        while (curr)
-        {
-            if (curr->username == username)
-            {
-                cout << RED << "Username already exists. Please choose a different username." << RESET << endl;
-                return;
-            }
-            curr = curr->next;
-        }
-        // Validate role input
-        if (!(role == "admin" || role == "editor" || role == "viewer")) {
-            cout << RED << "Invalid role specified. Please use 'admin', 'editor', or 'viewer'." << RESET << endl;
-            return;
-        }
-        head = new UserNode{ username, password, role, secAns, "", head };
-        cout << GREEN << "Signup successful! Welcome, " << username << "!" << RESET << endl;
-    }
-
-    // Authenticate user login
-    bool login(string username, string password)
-    {
-        UserNode* curr = head;
-        while (curr)
-        {
-            if (curr->username == username && curr->password == password)
-            {
-                cout << GREEN << "Login successful!" << RESET << endl;
-                return true;
-            }
-            curr = curr->next;
-        }
-        cout << RED << "Invalid username or password." << RESET << endl;
-        return false;
-    }
-
-    // Password recovery using security question
-    bool forgot(string username, string ans)
-    {
-        UserNode* curr = head;
-        while (curr)
-        {
-            if (curr->username == username && curr->securityAnswer == ans)
-            {
-                cout << GREEN << "Your password is: " << curr->password << RESET << endl;
-                return true;
-            }
-            curr = curr->next;
-        }
-        cout << RED << "Invalid username or security answer." << RESET << endl;
-        return false;
-    }
-
-    // Record logout time for user
-    void logout(string username)
-    {
-        time_t now = time(0);
-        char dt[26];
-        ctime_s(dt, sizeof(dt), &now); // ctime_s for secure version
-        string timeStr(dt);
-        UserNode* curr = head;
-        while (curr)
-        {
-            if (curr->username == username)
-            {
-                curr->lastLogout = timeStr;
-                break;
-            }
-            curr = curr->next;
-        }
-    }
-
-    // Get user role
-    string getUserRole(string username) {
-        UserNode* curr = head;
-        while (curr) {
-            if (curr->username == username) {
-                return curr->role;
-            }
-            curr = curr->next;
-        }
-        return ""; // User not found
-    }
-};
-
-// Graph-based user connections for file sharing
-class UserGraph
-{
-public:
-    UserGraphNode* head;
-
-    UserGraph()
-    {
-        head = nullptr;
-    }
-
-    // Destructor to clean up user graph nodes
-    ~UserGraph() {
-        delete head; // Recursively deletes all UserGraphNode nodes
-    }
-
-    // Add a new user to the graph
-    void addUser(string username)
-    {
-        UserGraphNode* newUser = new UserGraphNode{ username, {}, nullptr };
-        if (!head)
-        {
-            head = newUser;
-        }
-        else
-        {
-            UserGraphNode* curr = head;
-            while (curr->next)
-            {
-                curr = curr->next;
-            }
-            curr->next = newUser;
-        }
-        cout << GREEN << "User '" << username << "' added to user graph for sharing." << RESET << endl;
-    }
-
-    // Helper to find a user in the graph
-    UserGraphNode* findUserNode(string username) {
-        UserGraphNode* curr = head;
-        while (curr) {
-            if (curr->username == username) {
-                return curr;
-            }
-            curr = curr->next;
-        }
-        return nullptr;
-    }
-
-    // Share a file with another user
-    void shareFile(string ownerUsername, string receiverUsername, string filename, string permission)
-    {
-        UserGraphNode* ownerNode = findUserNode(ownerUsername);
-        UserGraphNode* receiverNode = findUserNode(receiverUsername);
-
-        if (!ownerNode) {
-            cout << RED << "Owner user '" << ownerUsername << "' not found in graph." << RESET << endl;
-            return;
-        }
-        if (!receiverNode) {
-            cout << RED << "Receiver user '" << receiverUsername << "' not found in graph." << RESET << endl;
-            return;
-        }
-
-        // Simple permission validation
-        if (!(permission == "read" || permission == "write" || permission == "execute")) {
-            cout << RED << "Invalid permission. Use 'read', 'write', or 'execute'." << RESET << endl;
-            return;
-        }
-
-        // Add the shared file info to the owner's sharedFiles list (as they initiated the share)
-        // Or you could add it to the receiver's list, depending on design.
-        // For simplicity, let's add it to the owner's outbound shares.
-        ownerNode->sharedFiles.emplace_back(receiverUsername, filename, permission);
-        cout << GREEN << "File '" << filename << "' shared by " << ownerUsername
-             << " with " << receiverUsername << " with permission: " << permission << RESET << endl;
-    }
-
-    // Display shared files for a user (files they have shared with others)
-    void displaySharedFiles(string username)
-    {
-        UserGraphNode* curr = findUserNode(username);
-        if (!curr)
-        {
-            cout << RED << "User '" << username << "' not found." << RESET << endl;
-            return;
-        }
-
-        if (curr->sharedFiles.empty()) {
-            cout << YELLOW << username << " has not shared any files." << RESET << endl;
-            return;
-        }
-
-        cout << CYAN << "Files shared by " << username << ":" << RESET << endl;
-        for (const auto& share : curr->sharedFiles)
-        {
-            cout << YELLOW << "-> Shared with: " << get<0>(share)
-                 << ", File: " << get<1>(share)
-                 << ", Permission: " << get<2>(share) << RESET << endl;
-        }
-    }
-
-    // Display files shared *with* a user (inbound shares)
-    void displayFilesSharedWithMe(string username) {
-        if (!head) {
-            cout << RED << "No users in the graph." << RESET << endl;
-            return;
-        }
-
-        bool foundShares = false;
-        cout << CYAN << "Files shared with " << username << ":" << RESET << endl;
-        UserGraphNode* ownerNode = head;
-        while (ownerNode) {
-            for (const auto& share : ownerNode->sharedFiles) {
-                if (get<0>(share) == username) { // If receiver is current user
-                    cout << YELLOW << "<- From: " << ownerNode->username
-                         << ", File: " << get<1>(share)
-                         << ", Permission: " << get<2>(share) << RESET << endl;
-                    foundShares = true;
-                }
-            }
-            ownerNode = ownerNode->next;
-        }
-
-        if (!foundShares) {
-            cout << YELLOW << "No files have been shared with " << username << "." << RESET << endl;
-        }
-    }
-};
-
-// Main File System class
-class FileSystem
-{
-public:
-    FolderNode* root;       // Root directory
-    FolderNode* current;    // Current working directory
-    HashTable metadata;     // Stores file metadata
-    RecycleBin bin;         // Recycle bin for deleted files
-    FileQueue recent;       // Recent files queue
-    UserAuth auth;          // User authentication system
-    UserGraph userGraph;    // User graph for file sharing
-    FilePriorityHeap fileHeap; // Heap for managing file priorities
-    string loggedInUser;    // Currently logged in user
-    string loggedInUserRole; // Role of the currently logged in user
-
-    // Constructor to initialize file system
-    FileSystem() : fileHeap(100)
-    {
-        root = new FolderNode{ "root", nullptr, nullptr, nullptr, nullptr };
-        current = root;
-        loggedInUser = "";
-        loggedInUserRole = "";
-        auth.signup("admin", "admin123", "admin", "secret"); // Default admin user
-        userGraph.addUser("admin"); // Add admin to graph
-    }
-
-    // Destructor to clean up the entire file system hierarchy
-    ~FileSystem() {
-        delete root; // Calls FolderNode's destructor, which recursively deletes everything
-    }
-
-    // Create a new folder in current directory
-    void createFolder(string name)
-    {
-        // Check for duplication
-        FolderNode* temp = current->child;
-        while (temp) {
-            if (temp->name == name) {
-                cout << RED << "Folder '" << name << "' already exists in this directory." << RESET << endl;
-                return;
-            }
-            temp = temp->sibling;
-        }
-
-        FolderNode* newFolder = new FolderNode{ name, current, nullptr, nullptr, nullptr };
-        if (!current->child)
-        {
-            current->child = newFolder;
-        }
-        else
-        {
-            temp = current->child;
-            while (temp->sibling)
-            {
-                temp = temp->sibling;
-            }
-            temp->sibling = newFolder;
-        }
-        cout << GREEN << "Folder created: " << name << RESET << endl;
-    }
-
-    // Create a new file with initial content
-    void createFile(string name, string type, string content, int priority = 0)
-    {
-        // Permission check for creating files
-        if (loggedInUserRole != "admin" && loggedInUserRole != "editor") {
-             cout << RED << "Permission denied. Only admins and editors can create files." << RESET << endl;
-             return;
-        }
-
-        FolderNode* targetFolder = current;
-        if (current->child) {
-            cout << "Available subfolders in current directory:" << endl;
-            FolderNode* temp = current->child;
-            int i = 1;
-            while (temp) {
-                cout << i << ". " << temp->name << endl;
-                i++;
-                temp = temp->sibling;
-            }
-            cout << "Enter subfolder name to create the file in, or type 'current' to use current directory: ";
-            string folderNameChoice;
-            getline(cin, folderNameChoice);
-
-            if (!folderNameChoice.empty() && folderNameChoice != "current") {
-                temp = current->child;
-                while (temp) {
-                    if (temp->name == folderNameChoice) {
-                        targetFolder = temp;
-                        break;
-                    }
-                    temp = temp->sibling;
-                }
-                if (!temp) {
-                    cout << YELLOW << "Subfolder '" << folderNameChoice << "' not found. File will be created in the current directory." << RESET << endl;
-                }
-            }
-        }
-
-        // Check if file with same name already exists in target folder
-        FileNode* existingFile = targetFolder->files;
-        while (existingFile) {
-            if (existingFile->name == name) {
-                cout << YELLOW << "File '" << name << "' already exists. Adding a new version instead." << RESET << endl;
-                // Add new version to existing file
-                FileVersion* newVersion = new FileVersion{ content, nullptr, nullptr };
-                FileVersion* ver = existingFile->versionHead;
-                while (ver->next) {
-                    ver = ver->next;
-                }
-                ver->next = newVersion;
-                newVersion->prev = ver;
-                cout << GREEN << "New version added for file '" << name << "'." << RESET << endl;
-                recent.enqueue(name); // Mark as recently accessed
-                return; // Exit as new version added
-            }
-            existingFile = existingFile->next;
-        }
-
-        // If file does not exist, create new file and its first version
-        FileVersion* newVersion = new FileVersion{ content, nullptr, nullptr };
-        FileNode* newFile = new FileNode{ name, type, loggedInUser, newVersion, nullptr, priority };
-
-        if (!targetFolder->files)
-        {
-            targetFolder->files = newFile;
-        }
-        else
-        {
-            FileNode* temp = targetFolder->files;
-            while (temp->next)
-            {
-                temp = temp->next;
-            }
-            temp->next = newFile;
-        }
-
-        time_t now = time(0);
-        char dt[26];
-        ctime_s(dt, sizeof(dt), &now);
-        string dateStr(dt);
-        metadata.insert(name, type, content.length(), loggedInUser, dateStr);
-        recent.enqueue(name);
-        fileHeap.insert(newFile);
-        cout << GREEN << "File created: " << name << " in folder " << targetFolder->name << RESET << endl;
-    }
-
-    // List all folders in current directory
-    void listFolders()
-    {
-        FolderNode* temp = current->child;
-        if (!temp)
-        {
-            cout << RED << "No subfolders in current directory." << RESET << endl;
-        }
-        else
-        {
-            cout << CYAN << "Subfolders in '" << current->name << "':" << RESET << endl;
-            while (temp)
-            {
-                cout << YELLOW << temp->name << RESET << endl;
-                temp = temp->sibling;
-            }
-        }
-    }
-
-    // List all files in current directory
-    void listFiles()
-    {
-        FileNode* temp = current->files;
-        if (!temp)
-        {
-            cout << RED << "No files in current directory." << RESET << endl;
-        }
-        else
-        {
-            cout << CYAN << "Files in '" << current->name << "':" << RESET << endl;
-            while (temp)
-            {
-                cout << YELLOW << temp->name << " (" << temp->type << ", Owner: " << temp->owner << ")" << RESET << endl;
-                temp = temp->next;
-            }
-        }
-    }
-
-    // Find a file node in the current directory
-    FileNode* findFileInCurrentDirectory(string name) {
-        FileNode* temp = current->files;
-        while (temp) {
-            if (temp->name == name) {
-                return temp;
-            }
-            temp = temp->next;
-        }
-        return nullptr;
-    }
-
-    // Display latest content of a file
-    void readFile(string name)
-    {
-        FileNode* file = findFileInCurrentDirectory(name);
-        if (!file)
-        {
-            cout << RED << "File not found in current directory." << RESET << endl;
-            return;
-        }
-
-        // Access control check
-        if (!file->canAccess(loggedInUserRole, "read")) { // Check if user has read permission
-            cout << RED << "Permission denied to read file '" << name << "'." << RESET << endl;
-            return;
-        }
-
-        FileVersion* ver = file->versionHead;
-        while (ver->next) ver = ver->next; // Go to latest version
-        cout << GREEN << "Latest Content of '" << name << "': " << ver->content << RESET << endl;
-        recent.enqueue(name); // Mark as recently accessed
-    }
-
-    // Add new version to a file
-    void updateFile(string name, string newContent)
-    {
-        FileNode* file = findFileInCurrentDirectory(name);
-        if (!file)
-        {
-            cout << RED << "File not found in current directory." << RESET << endl;
-            return;
-        }
-
-        // Access control check
-        if (!file->canAccess(loggedInUserRole, "write")) {
-            cout << RED << "Permission denied to write to file '" << name << "'." << RESET << endl;
-            return;
-        }
-
-        FileVersion* ver = file->versionHead;
-        while (ver->next) ver = ver->next; // Go to latest version
-        FileVersion* newVer = new FileVersion{ newContent, ver, nullptr };
-        ver->next = newVer;
-        cout << GREEN << "File '" << name << "' updated with new version." << RESET << endl;
-        recent.enqueue(name); // Mark as recently accessed
-    }
-
-    // Revert to previous version of a file
-    void rollbackFile(string name)
-    {
-        FileNode* file = findFileInCurrentDirectory(name);
-        if (!file) {
-            cout << RED << "File not found in current directory." << RESET << endl;
-            return;
-        }
-
-        // Access control check
-        if (!file->canAccess(loggedInUserRole, "write")) { // Rollback is a write operation
-            cout << RED << "Permission denied to rollback file '" << name << "'." << RESET << endl;
-            return;
-        }
-
-        if (file->versionHead->next == nullptr) // Only one version exists
-        {
-            cout << RED << "No older version to rollback for file '" << name << "'." << RESET << endl;
-            return;
-        }
-
-        FileVersion* ver = file->versionHead;
-        while (ver->next) ver = ver->next; // Go to the latest version
-
-        FileVersion* toDelete = ver; // This is the latest version we want to remove
-        ver = ver->prev;             // Move back to the previous version
-        ver->next = nullptr;         // Disconnect the latest version
-
-        toDelete->prev = nullptr; // Disconnect the old prev pointer
-        delete toDelete; // Delete the latest version (which recursively cleans up)
-
-        cout << GREEN << "File '" << name << "' rolled back to previous version." << RESET << endl;
-        recent.enqueue(name); // Mark as recently accessed
-    }
-
-    // Change current working directory
-    void changeDirectory(string name)
-    {
-        if (name == ".." && current->parent)
-        {
-            current = current->parent;
-            cout << GREEN << "Changed directory to parent." << RESET << endl;
-            return;
-        }
-        if (name == "root") { // Special case to go to root
-            current = root;
-            cout << GREEN << "Changed directory to root." << RESET << endl;
-            return;
-        }
-
-        FolderNode* temp = current->child;
-        while (temp)
-        {
-            if (temp->name == name)
-            {
-                current = temp;
-                cout << GREEN << "Changed directory to: " << name << RESET << endl;
-                return;
-            }
-            temp = temp->sibling;
-        }
-        cout << RED << "Folder '" << name << "' not found in current directory." << RESET << endl;
-    }
-
-    // Delete a file (moves to recycle bin)
-    void deleteFile(string name)
-    {
-        FileNode* curr = current->files;
-        FileNode* prev = nullptr;
-        while (curr)
-        {
-            if (curr->name == name)
-            {
-                // Access control check
-                if (!curr->canAccess(loggedInUserRole, "write")) { // Deletion is a write operation
-                    cout << RED << "Permission denied to delete file '" << name << "'." << RESET << endl;
-                    return;
-                }
-
-                // Traverse to the latest version of the file
-                FileVersion* ver = curr->versionHead;
-                while (ver->next)
-                {
-                    ver = ver->next;
-                }
-                // Save the latest content to the recycle bin
-                bin.push(name, ver->content);
-
-                // Remove the file from the current directory
-                if (prev)
-                {
-                    prev->next = curr->next;
-                }
-                else
-                {
-                    current->files = curr->next;
-                }
-                curr->next = nullptr; // Detach curr from the list to prevent deleting subsequent files
-                delete curr; // This will call FileNode's destructor and recursively delete FileVersions
-                metadata.remove(name); // Also remove from metadata hash table
-                cout << GREEN << "File '" << name << "' successfully deleted and moved to Recycle Bin." << RESET << endl;
-                return;
-            }
-            prev = curr;
-            curr = curr->next;
-        }
-        cout << RED << "File '" << name << "' not found in current directory." << RESET << endl;
-    }
-
-    // Delete a folder (and its contents)
-    void deleteFolder(string name) {
-        if (loggedInUserRole != "admin") {
-            cout << RED << "Permission denied. Only admins can delete folders." << RESET << endl;
-            return;
-        }
-
-        if (name == ".." || name == "root") {
-            cout << RED << "Cannot delete special folders like '..' or 'root'." << RESET << endl;
-            return;
-        }
-
-        FolderNode* curr = current->child;
-        FolderNode* prev = nullptr;
-        while (curr) {
-            if (curr->name == name) {
-                // Confirm deletion for safety
-                cout << YELLOW << "WARNING: Deleting folder '" << name << "' will permanently delete all its contents. Are you sure? (yes/no): " << RESET;
-                string confirmation;
-                getline(cin, confirmation);
-                if (confirmation != "yes") {
-                    cout << BLUE << "Folder deletion cancelled." << RESET << endl;
-                    return;
-                }
-
-                if (prev) {
-                    prev->sibling = curr->sibling;
-                } else {
-                    current->child = curr->sibling;
-                }
-                curr->sibling = nullptr; // Detach from the sibling list
-                delete curr; // Calls FolderNode's destructor, which recursively deletes all contained files and subfolders
-                cout << GREEN << "Folder '" << name << "' and its contents permanently deleted." << RESET << endl;
-                return;
-            }
-            prev = curr;
-            curr = curr->sibling;
-        }
-        cout << RED << "Folder '" << name << "' not found in current directory." << RESET << endl;
-    }
-
-
-    // Print current directory path
-    void printCurrentPath()
-    {
-        FolderNode* temp = current;
-        string path = "";
-        while (temp)
-        {
-            path = "/" + temp->name + path;
-            temp = temp->parent;
-        }
-        cout << BLUE << "Current Path: " << path << RESET << endl;
-    }
-
-    // Display file metadata
-    void viewMetadata(string name)
-    {
-        fileData* meta = metadata.search(name);
-        if (!meta)
-        {
-            cout << RED << "Metadata not found for file '" << name << "'." << RESET << endl;
-        }
-        else
-        {
-            cout << CYAN << "Metadata for '" << name << "':" << RESET << endl;
-            cout << YELLOW << "Name: " << meta->name << "\nType: " << meta->type
-                << "\nOwner: " << meta->owner << "\nSize: " << meta->size << " bytes"
-                << "\nDate Created/Modified: " << meta->date << RESET << endl;
-        }
-    }
-
-    // Share a file with another user
-    void shareFileWithUser(string receiver, string filename, string permission)
-    {
-        // Check if the file exists and loggedInUser is its owner or has execute access (for sharing)
-        FileNode* fileToShare = findFileInCurrentDirectory(filename);
-        if (!fileToShare) {
-            cout << RED << "File '" << filename << "' not found in current directory." << RESET << endl;
-            return;
-        }
-        // Simplified check: only owner can share. More complex rules can be added.
-        if (fileToShare->owner != loggedInUser) {
-            cout << RED << "Permission denied. You are not the owner of file '" << filename << "'." << RESET << endl;
-            return;
-        }
-
-        userGraph.shareFile(loggedInUser, receiver, filename, permission);
-    }
-
-    // Display files shared by the logged-in user
-    void displaySharedFilesByMe()
-    {
-        userGraph.displaySharedFiles(loggedInUser);
-    }
-
-    // Display files shared with the logged-in user
-    void displayFilesSharedWithMe() {
-        userGraph.displayFilesSharedWithMe(loggedInUser);
-    }
-
-
-    // Display files by priority
-    void displayFilesByPriority()
-    {
-        fileHeap.display();
-    }
-};
-
-// Main program loop
-int main()
-{
-    FileSystem fs;
-    int choice;
-    string name;
-    string content;
-    string type;
-    string username;
-    string password;
-    string role;
-    string secAns;
-    string receiver;
-    string permission;
-    int priority;
-
-    while (true) {
-        cout << BOLD << MAGENTA << "--- Google Drive File System ---" << RESET << endl;
-        if (!fs.loggedInUser.empty()) {
-            cout << BOLD << CYAN << "Logged in as: " << fs.loggedInUser << " (" << fs.loggedInUserRole << ")" << RESET << endl;
-            fs.printCurrentPath();
-        } else {
-            cout << YELLOW << "Please login or signup to use the file system." << RESET << endl;
-        }
-        cout << CYAN << "1. Signup" << RESET << endl;
-        cout << CYAN << "2. Login" << RESET << endl;
-        cout << CYAN << "3. Forgot Password" << RESET << endl;
-        cout << CYAN << "4. Create Folder" << RESET << endl;
-        cout << CYAN << "5. Create File" << RESET << endl;
-        cout << CYAN << "6. List Folders" << RESET << endl;
-        cout << CYAN << "7. List Files" << RESET << endl;
-        cout << CYAN << "8. Change Directory" << RESET << endl;
-        cout << CYAN << "9. Show Current Path" << RESET << endl;
-        cout << CYAN << "10. Read File" << RESET << endl;
-        cout << CYAN << "11. Update File (Add New Version)" << RESET << endl;
-        cout << CYAN << "12. Rollback File to Previous Version" << RESET << endl;
-        cout << CYAN << "13. Delete File (Move to Recycle Bin)" << RESET << endl;
-        cout << CYAN << "14. Delete Folder" << RESET << endl; // New option
-        cout << CYAN << "15. View File Metadata" << RESET << endl;
-        cout << CYAN << "16. View Last Deleted File (Recycle Bin Top)" << RESET << endl;
-        cout << CYAN << "17. Restore Last Deleted File (Recycle Bin Pop)" << RESET << endl; // New option
-        cout << CYAN << "18. Display All Recycle Bin Contents" << RESET << endl; // New option
-        cout << CYAN << "19. Recent Files (LRU)" << RESET << endl;
-        cout << CYAN << "20. Share File" << RESET << endl;
-        cout << CYAN << "21. View Files Shared By Me" << RESET << endl;
-        cout << CYAN << "22. View Files Shared With Me" << RESET << endl; // New option
-        cout << CYAN << "23. Display Files by Priority" << RESET << endl;
-        cout << CYAN << "24. Logout" << RESET << endl;
-        cout << CYAN << "0. Exit" << RESET << endl;
-
-        while (true) {
-            cout << GREEN << "Enter choice: " << RESET;
-            if (cin >> choice) {
-                cin.ignore(numeric_limits<streamsize>::max(), '\n'); // Clear buffer
-                break;
-            }
-            else {
-                cout << RED << "Invalid input. Please enter a number." << RESET << endl;
-                cin.clear(); // Clear error flags
-                cin.ignore(numeric_limits<streamsize>::max(), '\n'); // Discard invalid input
-            }
-        }
-
-        if (choice == 1) // Signup
-        {
-            cout << "Enter Username: ";
-            getline(cin, username);
-            cout << "Enter Password: ";
-            getline(cin, password);
-            while (true) {
-                cout << "Enter your role (admin, editor, viewer): ";
-                getline(cin, role);
-                if (role == "admin" || role == "editor" || role == "viewer") {
-                    break;
-                }
-                else {
-                    cout << RED << "Invalid role. Please enter admin, editor, or viewer." << RESET << endl;
-                }
-            }
-            cout << "Enter your recovery code (e.g., your favorite color): ";
-            getline(cin, secAns);
-            fs.auth.signup(username, password, role, secAns);
-            fs.userGraph.addUser(username); // Add user to the graph for sharing
-            pauseAndClear();
-        }
-        else if (choice == 2) // Login
-        {
-            cout << "Enter Username: ";
-            getline(cin, username);
-            cout << "Enter Password: ";
-            getline(cin, password);
-            if (fs.auth.login(username, password))
-            {
-                fs.loggedInUser = username;
-                fs.loggedInUserRole = fs.auth.getUserRole(username); // Get role after login
-                cout << GREEN << "Welcome, " << username << " (" << fs.loggedInUserRole << ")!" << RESET << endl;
-            }
-            pauseAndClear();
-        }
-        else if (choice == 3) // Forgot Password
-        {
-            cout << "Enter Username: ";
-            getline(cin, username);
-            cout << "Enter Security Answer: ";
-            getline(cin, secAns);
-            fs.auth.forgot(username, secAns);
-            pauseAndClear();
-        }
-        else if (choice == 0) // Exit
-        {
-            cout << "Exiting Google Drive File System. Goodbye!" << endl;
-            break;
-        }
-        // Rest of the functionalities require login
-        else if (fs.loggedInUser.empty())
-        {
-            cout << RED << "Permission denied. Please login first to perform this action." << RESET << endl;
-            pauseAndClear();
-        }
-        else if (choice == 4) // Create Folder
-        {
-            cout << "Enter Folder name: ";
-            getline(cin, name);
-            fs.createFolder(name);
-            pauseAndClear();
-        }
-        else if (choice == 5) // Create File
-        {
-            cout << "Enter File name: ";
-            getline(cin, name);
-            cout << "Enter File type (e.g., .txt, .pdf): ";
-            getline(cin, type);
-            cout << "Enter File content: ";
-            getline(cin, content);
-            cout << "Enter File priority (0-100, higher for more important): ";
-            // Input validation for priority
-            while (!(cin >> priority) || priority < 0 || priority > 100) {
-                cout << RED << "Invalid priority. Please enter a number between 0 and 100: " << RESET;
-                cin.clear();
-                cin.ignore(numeric_limits<streamsize>::max(), '\n');
-            }
-            cin.ignore(numeric_limits<streamsize>::max(), '\n'); // Clear buffer after numeric input
-            fs.createFile(name, type, content, priority);
-            pauseAndClear();
-        }
-        else if (choice == 6) // List Folders
-        {
-            fs.listFolders();
-            pauseAndClear();
-        }
-        else if (choice == 7) // List Files
-        {
-            fs.listFiles();
-            pauseAndClear();
-        }
-        else if (choice == 8) // Change Directory
-        {
-            cout << "Enter Folder name to change to (or '..' to go back, 'root' to go to root): ";
-            getline(cin, name);
-            fs.changeDirectory(name);
-            pauseAndClear();
-        }
-        else if (choice == 9) // Show Current Path
-        {
-            fs.printCurrentPath();
-            pauseAndClear();
-        }
-        else if (choice == 10) // Read File
-        {
-            cout << "Enter File name to read: ";
-            getline(cin, name);
-            fs.readFile(name);
-            pauseAndClear();
-        }
-        else if (choice == 11) // Update File (Add New Version)
-        {
-            cout << "Enter File name to update: ";
-            getline(cin, name);
-            cout << "Enter New content: ";
-            getline(cin, content);
-            fs.updateFile(name, content);
-            pauseAndClear();
-        }
-        else if (choice == 12) // Rollback File
-        {
-            cout << "Enter File name to rollback: ";
-            getline(cin, name);
-            fs.rollbackFile(name);
-            pauseAndClear();
-        }
-        else if (choice == 13) // Delete File (Move to Recycle Bin)
-        {
-            cout << "Enter File name to delete: ";
-            getline(cin, name);
-            fs.deleteFile(name);
-            pauseAndClear();
-        }
-        else if (choice == 14) // Delete Folder (New)
-        {
-            cout << "Enter Folder name to delete: ";
-            getline(cin, name);
-            fs.deleteFolder(name);
-            pauseAndClear();
-        }
-        else if (choice == 15) // View Metadata
-        {
-            cout << "Enter File name to view metadata: ";
-            getline(cin, name);
-            fs.viewMetadata(name);
-            pauseAndClear();
-        }
-        else if (choice == 16) // View Last Deleted File (Recycle Bin Top)
-        {
-            fs.bin.viewTop();
-            pauseAndClear();
-        }
-        else if (choice == 17) // Restore Last Deleted File (Recycle Bin Pop) (New)
-        {
-            DeletedFile* restored = fs.bin.pop();
-            if (restored) {
-                // To fully restore, we need to recreate the file in the current folder.
-                // For simplicity, we just show it's restored here.
-                // In a real system, you'd ask where to restore and recreate FileNode.
-                cout << GREEN << "Restored file '" << restored->name << "' with content: '" << restored->content << "'" << RESET << endl;
-                delete restored; // Clean up the DeletedFile object after use
-            }
-            pauseAndClear();
-        }
-        else if (choice == 18) // Display All Recycle Bin Contents (New)
-        {
-            fs.bin.displayAll();
-            pauseAndClear();
-        }
-        else if (choice == 19) // Recent Files (LRU)
-        {
-            fs.recent.display();
-            pauseAndClear();
-        }
-        else if (choice == 20) // Share File
-        {
-            cout << "Enter Receiver Username: ";
-            getline(cin, receiver);
-            cout << "Enter File name to share (must be in current directory): ";
-            getline(cin, name);
-            cout << "Enter Permission (read/write/execute): ";
-            getline(cin, permission);
-            fs.shareFileWithUser(receiver, name, permission);
-            pauseAndClear();
-        }
-        else if (choice == 21) // View Files Shared By Me
-        {
-            fs.displaySharedFilesByMe();
-            pauseAndClear();
-        }
-        else if (choice == 22) // View Files Shared With Me (New)
-        {
-            fs.displayFilesSharedWithMe();
-            pauseAndClear();
-        }
-        else if (choice == 23) // Display Files by Priority
-        {
-            fs.displayFilesByPriority();
-            pauseAndClear();
-        }
-        else if (choice == 24) // Logout
-        {
-            fs.auth.logout(fs.loggedInUser);
-            fs.loggedInUser = "";
-            fs.loggedInUserRole = ""; // Clear role on logout
-            cout << GREEN << "You have been logged out." << RESET << endl;
-            pauseAndClear();
-        }
-        else {
-            cout << RED << "Invalid choice. Please enter a valid option." << RESET << endl;
-            pauseAndClear();
-        }
-    }
-    // system("pause"); // This is Windows specific, might not work on other OS
-    return 0;
-}
+#include <iostream>
+#include <string>
+#include <ctime>
+#include <cstdlib>
+#include <limits> // For numeric_limits
+#include <vector> // For dynamic array for shared files
+#include <cstdint>
+#include <unordered_map>
+#include <list>
+#include <set>
+#include <unordered_set>
+#include <sstream>
+#include <cstdio>
+#include <cstring> // For memcmp
+#include <cctype>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <new>     // For placement new in the node pools
+#include <utility> // For forward/move
+#include <fstream> // For recycle bin spill segments
+#include <deque>
+#include <string_view>
+#include <functional>
+#include <charconv> // For from_chars
+#include <random>   // For credential salts
+#include <cerrno>
+#include <fcntl.h>    // For content segment files
+#include <sys/stat.h>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h> // For mapping the namespace image
+#include <io.h>      // For _commit
+#include <process.h> // For _getpid
+#else
+#include <sys/mman.h> // For mapping the namespace image
+#include <unistd.h>   // For fsync
+#endif
+#ifdef __linux__
+#include <sys/sendfile.h> // For reads that bypass user space
+#endif
+
+using namespace std;
+
+// ANSI color codes for console output
+#define RESET   "\033[0m"
+#define RED     "\033[31m"
+#define GREEN   "\033[32m"
+#define YELLOW  "\033[33m"
+#define BLUE    "\033[34m"
+#define MAGENTA "\033[35m"
+#define CYAN    "\033[36m"
+#define WHITE   "\033[37m"
+#define BOLD    "\033[1m"
+
+// Helper function to pause and clear screen
+void pauseAndClear() {
+    cout << "\nPress Enter to continue...";
+    cin.ignore(numeric_limits<streamsize>::max(), '\n'); // Clear buffer before ignoring
+    system("cls"); // For Windows, use "clear" for Linux/macOS
+}
+
+// Timestamps are stored as 64-bit seconds since the epoch and only turned
+// into text when displayed
+typedef int64_t Timestamp;
+
+// While the write-ahead log is replayed, operations take the time recorded
+// with them instead of the wall clock (per thread, so the reaper is unaffected)
+thread_local Timestamp clockOverride = 0;
+
+Timestamp currentTime()
+{
+    return clockOverride ? clockOverride : static_cast<Timestamp>(time(0));
+}
+
+// Format a timestamp for display, e.g. "Thu May 08 14:03:12 2025"
+string formatTime(Timestamp timestamp)
+{
+    if (timestamp == 0) {
+        return "never";
+    }
+    time_t t = static_cast<time_t>(timestamp);
+    tm local = {};
+#ifdef _WIN32
+    localtime_s(&local, &t);
+#else
+    localtime_r(&t, &local);
+#endif
+    char buffer[32];
+    strftime(buffer, sizeof(buffer), "%a %b %d %H:%M:%S %Y", &local);
+    return buffer;
+}
+
+// Content-defined chunking bounds: a chunk ends where the rolling hash matches
+// CHUNK_BOUNDARY_MASK, but never before CHUNK_MIN_SIZE or after CHUNK_MAX_SIZE bytes
+const size_t CHUNK_MIN_SIZE = 512;
+const size_t CHUNK_MAX_SIZE = 8192;
+const uint64_t CHUNK_BOUNDARY_MASK = (1 << 11) - 1; // ~2 KB average chunk
+
+// Mix a 64-bit value (splitmix64 finalizer)
+uint64_t mixHash(uint64_t x)
+{
+    x ^= x >> 30; x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27; x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+// Strong 64-bit hash of a byte range (FNV-1a followed by a final mix)
+uint64_t hashBytes(const char* data, size_t length)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < length; i++) {
+        h ^= static_cast<unsigned char>(data[i]);
+        h *= 0x100000001b3ULL;
+    }
+    return mixHash(h ^ length);
+}
+
+// Chunk bytes live in append-only content segment files rather than in RAM.
+// A segment is sealed once it reaches CONTENT_SEGMENT_MAX_BYTES, and a sealed
+// segment is compacted in the background once COMPACTION_GARBAGE_RATIO of its
+// bytes belong to chunks nothing refers to any more.
+const uint64_t CONTENT_SEGMENT_MAX_BYTES = 64 * 1024 * 1024;
+const size_t CONTENT_WRITE_BUFFER_BYTES = 1024 * 1024; // New chunks are written to the segment in batches of this size
+const double COMPACTION_GARBAGE_RATIO = 0.5;
+const size_t COMPACTION_BATCH_SIZE = 256; // Chunks relocated per lock hold
+const uint32_t IN_MEMORY_SEGMENT = 0xFFFFFFFFu; // Chunk kept in RAM because no segment could be written
+const size_t STREAMED_READ_MIN_BYTES = 64 * 1024; // Files at least this big are read straight from their segments
+
+// Chunk table entry of the namespace image, sorted by ID. refCount is the
+// number of references held by the file records in that image.
+struct ImageChunk {
+    uint64_t id;
+    uint64_t offset;
+    uint32_t segment;
+    uint32_t length;
+    uint64_t refCount;
+};
+
+// Segment table entry of the namespace image
+struct ImageSegment {
+    uint32_t id;
+    uint32_t reserved;
+    uint64_t bytes;
+    uint64_t liveBytes;
+};
+
+static_assert(sizeof(ImageChunk) == 32 && sizeof(ImageSegment) == 24, "image records must not change size");
+
+// Create a new file for reading and writing; -1 on failure, with errno
+// EEXIST if the file is already there (it is never overwritten)
+int createSegmentFile(const string& path) {
+#ifdef _WIN32
+    return _open(path.c_str(), _O_RDWR | _O_CREAT | _O_EXCL | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+    return ::open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+#endif
+}
+
+// Open a file written by an earlier run for reading and writing; -1 on failure
+int openSegmentFile(const string& path) {
+#ifdef _WIN32
+    return _open(path.c_str(), _O_RDWR | _O_BINARY);
+#else
+    return ::open(path.c_str(), O_RDWR);
+#endif
+}
+
+// Size of an open segment file (0 if it cannot be determined)
+uint64_t segmentFileSize(int fd) {
+#ifdef _WIN32
+    long long size = _lseeki64(fd, 0, SEEK_END);
+#else
+    off_t size = lseek(fd, 0, SEEK_END);
+#endif
+    return size < 0 ? 0 : static_cast<uint64_t>(size);
+}
+
+// Force a segment file's written data to stable storage
+bool syncSegmentFile(int fd) {
+#ifdef _WIN32
+    return _commit(fd) == 0;
+#else
+    return fsync(fd) == 0;
+#endif
+}
+
+void closeSegmentFile(int fd) {
+#ifdef _WIN32
+    _close(fd);
+#else
+    ::close(fd);
+#endif
+}
+
+// Read exactly `length` bytes at `offset` without moving the file position
+bool readAt(int fd, uint64_t offset, char* buffer, size_t length) {
+    while (length > 0) {
+#ifdef _WIN32
+        unsigned int want = static_cast<unsigned int>(min<size_t>(length, 1 << 30));
+        int got = _lseeki64(fd, offset, SEEK_SET) < 0 ? -1 : _read(fd, buffer, want);
+#else
+        ssize_t got = pread(fd, buffer, length, static_cast<off_t>(offset));
+#endif
+        if (got <= 0) {
+            return false;
+        }
+        buffer += got;
+        offset += got;
+        length -= got;
+    }
+    return true;
+}
+
+// Write exactly `length` bytes at `offset`
+bool writeAt(int fd, uint64_t offset, const char* data, size_t length) {
+    while (length > 0) {
+#ifdef _WIN32
+        unsigned int want = static_cast<unsigned int>(min<size_t>(length, 1 << 30));
+        int put = _lseeki64(fd, offset, SEEK_SET) < 0 ? -1 : _write(fd, data, want);
+#else
+        ssize_t put = pwrite(fd, data, length, static_cast<off_t>(offset));
+#endif
+        if (put <= 0) {
+            return false;
+        }
+        data += put;
+        offset += put;
+        length -= put;
+    }
+    return true;
+}
+
+// Write all of `data` to a descriptor such as the terminal
+bool writeAll(int fd, const char* data, size_t length) {
+    while (length > 0) {
+#ifdef _WIN32
+        int put = _write(fd, data, static_cast<unsigned int>(min<size_t>(length, 1 << 30)));
+#else
+        ssize_t put = write(fd, data, length);
+        if (put < 0 && errno == EINTR) {
+            continue;
+        }
+#endif
+        if (put <= 0) {
+            return false;
+        }
+        data += put;
+        length -= put;
+    }
+    return true;
+}
+
+// Send a byte range of a file to another descriptor. On Linux the kernel
+// copies it directly (sendfile), so the bytes never pass through this
+// process; elsewhere, or if the target does not support that, it goes
+// through a small fixed buffer.
+bool copyRange(int in, uint64_t offset, uint64_t length, int out) {
+#ifdef __linux__
+    off_t position = static_cast<off_t>(offset);
+    while (length > 0) {
+        ssize_t sent = sendfile(out, in, &position, static_cast<size_t>(min<uint64_t>(length, 1 << 30)));
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            break; // Finish with plain reads and writes
+        }
+        length -= sent;
+    }
+    offset = static_cast<uint64_t>(position);
+#endif
+    char buffer[64 * 1024];
+    while (length > 0) {
+        size_t part = static_cast<size_t>(min<uint64_t>(length, sizeof(buffer)));
+        if (!readAt(in, offset, buffer, part) || !writeAll(out, buffer, part)) {
+            return false;
+        }
+        offset += part;
+        length -= part;
+    }
+    return true;
+}
+
+// Binary record helpers for on-disk segments: fixed-size values are written
+// as raw bytes, strings as a 64-bit length followed by the characters
+template <typename T>
+void writeBinary(ostream& out, const T& value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+bool readBinary(istream& in, T& value) {
+    return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+void writeBinaryString(ostream& out, const string& value) {
+    writeBinary<uint64_t>(out, value.length());
+    out.write(value.data(), value.length());
+}
+
+bool readBinaryString(istream& in, string& value) {
+    uint64_t length;
+    if (!readBinary(in, length)) {
+        return false;
+    }
+    value.resize(length);
+    return static_cast<bool>(in.read(&value[0], length));
+}
+
+// Content-addressed store of deduplicated, reference-counted chunks. The
+// store keeps only the location (segment, offset, length) of every chunk;
+// the bytes are appended to the active content segment. A background
+// compactor copies the live chunks out of mostly-garbage segments and
+// deletes them.
+//
+// With persistence the segments are durable: the namespace image refers to
+// chunks by ID and carries a chunk table, the write-ahead log refers to them
+// by location, and a segment nothing uses any more is only deleted once a
+// checkpoint has replaced every image and log record that could still
+// point into it.
+class BlobStore
+{
+private:
+    struct Chunk {
+        uint32_t segment; // Content segment holding the bytes, or IN_MEMORY_SEGMENT
+        uint32_t length;
+        uint64_t offset;  // Position of the bytes in the segment
+        int refCount;
+        string data;      // The bytes themselves, only for chunks kept in memory
+    };
+
+    // Append-only file of chunk bytes
+    struct ContentSegment {
+        string path;
+        int fd;
+        uint64_t bytes;       // Bytes appended so far, including those still in the write buffer
+        uint64_t liveBytes;   // Bytes of chunks that are still referenced
+        bool compactable;     // Cleared if compaction could not empty the segment
+        int pins;             // Reads in progress without storeMutex; the file stays while non-zero
+        uint64_t syncedBytes; // Bytes known to be on disk
+        bool created;         // Made by this run rather than opened from an earlier one
+        bool expired;         // Retired and no longer referenced by the image or the log
+    };
+
+    unordered_map<uint64_t, Chunk> chunks; // Chunk ID (content hash) -> chunk, for chunks in use this run
+    unordered_map<uint32_t, ContentSegment> segments;
+    unordered_map<uint32_t, ContentSegment> retiredSegments; // Dropped but still pinned, or still needed by the image or the log
+    const ImageChunk* imageChunks;         // Chunk table of the mapped namespace image, sorted by ID
+    size_t imageChunkCount;
+    unordered_set<uint64_t> discarded;     // Image chunks released since that image was written
+    bool durable;                          // Keep segment files for the image and the log
+    bool detached;                         // Segments closed at shutdown; releases no longer touch them
+    uint32_t activeSegment;                // Segment new chunks are appended to, or IN_MEMORY_SEGMENT
+    uint32_t nextSegmentId;
+    string segmentPrefix;                  // Segment files are named <prefix><id>.seg
+    string writeBuffer;                    // Newest bytes of the active segment, not yet in its file
+    uint64_t flushedBytes;                 // Bytes of the active segment already in its file
+    string scratch;                        // Holds a stored chunk while it is compared
+    uint64_t gear[256];                    // Random table for the rolling gear hash
+    size_t logicalBytes;                   // Bytes referenced by all live blobs
+    size_t physicalBytes;                  // Bytes actually stored in unique chunks
+    long long compactions;                 // Segments emptied by the compactor
+    uint64_t relocatedBytes;               // Live bytes the compactor copied
+    mutable mutex storeMutex;              // Blobs are also released by the recycle bin reaper
+    condition_variable compactorWake;
+    bool stopping;
+    thread compactor;
+
+    // Write the buffered tail of the active segment to its file (caller holds storeMutex).
+    // If that fails, the chunks in the buffer are kept in memory instead.
+    void flushActive() {
+        if (writeBuffer.empty()) {
+            return;
+        }
+        uint32_t id = activeSegment;
+        ContentSegment& segment = segments[activeSegment];
+        if (!writeAt(segment.fd, flushedBytes, writeBuffer.data(), writeBuffer.length())) {
+            for (auto& entry : chunks) {
+                Chunk& chunk = entry.second;
+                if (chunk.segment == activeSegment && chunk.offset >= flushedBytes) {
+                    chunk.data.assign(writeBuffer, chunk.offset - flushedBytes, chunk.length);
+                    chunk.segment = IN_MEMORY_SEGMENT;
+                    segment.liveBytes -= chunk.length;
+                }
+            }
+            segment.bytes = flushedBytes;
+            writeBuffer.clear();
+            activeSegment = IN_MEMORY_SEGMENT; // Nothing more is appended to a segment that failed
+            if (segment.liveBytes == 0) {
+                dropSegment(id);
+            }
+            return;
+        }
+        flushedBytes += writeBuffer.length();
+        writeBuffer.clear();
+    }
+
+    // Stop appending to the active segment (caller holds storeMutex)
+    void sealActive() {
+        if (activeSegment == IN_MEMORY_SEGMENT) {
+            return;
+        }
+        flushActive();
+        if (activeSegment == IN_MEMORY_SEGMENT) {
+            return; // The flush failed and already gave the segment up
+        }
+        uint32_t sealed = activeSegment;
+        activeSegment = IN_MEMORY_SEGMENT;
+        if (segments[sealed].liveBytes == 0) {
+            dropSegment(sealed);
+        } else {
+            compactorWake.notify_one();
+        }
+    }
+
+    // Close a segment file, deleting it unless the image or the log may still need it
+    void closeSegment(const ContentSegment& segment) {
+        if (segment.fd >= 0) {
+            closeSegmentFile(segment.fd);
+        }
+        if (segment.expired || (!durable && segment.created)) {
+            remove(segment.path.c_str());
+        }
+    }
+
+    // Close and delete a segment nothing refers to, or retire it while it is
+    // pinned or the image or the log may still point into it (caller holds storeMutex)
+    void dropSegment(uint32_t id) {
+        auto it = segments.find(id);
+        if (durable || it->second.pins > 0) {
+            retiredSegments[id] = it->second;
+        } else {
+            closeSegment(it->second);
+        }
+        segments.erase(it);
+    }
+
+    // End a read that pinned a segment (caller holds storeMutex)
+    void unpinSegment(uint32_t id) {
+        auto it = segments.find(id);
+        if (it != segments.end()) {
+            if (--it->second.pins == 0 && garbageRatio(id, it->second) >= COMPACTION_GARBAGE_RATIO) {
+                compactorWake.notify_one(); // It may have been skipped while pinned
+            }
+            return;
+        }
+        it = retiredSegments.find(id);
+        if (--it->second.pins == 0 && (!durable || it->second.expired)) {
+            closeSegment(it->second);
+            retiredSegments.erase(it);
+        }
+    }
+
+    // A segment written by an earlier run (or retired in this one), opened for reading (caller holds storeMutex)
+    ContentSegment& openSegment(uint32_t id) {
+        auto it = segments.find(id);
+        if (it != segments.end()) {
+            return it->second;
+        }
+        auto retired = retiredSegments.find(id);
+        if (retired != retiredSegments.end()) {
+            ContentSegment& segment = segments[id] = retired->second;
+            retiredSegments.erase(retired);
+            return segment;
+        }
+        string path = segmentPrefix + to_string(id) + ".seg";
+        int fd = openSegmentFile(path); // Reads from a segment that cannot be opened fail like any unreadable chunk
+        uint64_t size = fd >= 0 ? segmentFileSize(fd) : 0;
+        nextSegmentId = max(nextSegmentId, id + 1);
+        return segments[id] = { path, fd, size, 0, true, 0, size, false, false };
+    }
+
+    // Entry of the image's chunk table for a chunk not yet in use this run, or nullptr
+    const ImageChunk* imageChunk(uint64_t id) const {
+        const ImageChunk* end = imageChunks + imageChunkCount;
+        const ImageChunk* entry = lower_bound(imageChunks, end, id, [](const ImageChunk& chunk, uint64_t key) { return chunk.id < key; });
+        if (entry == end || entry->id != id || discarded.count(id)) {
+            return nullptr;
+        }
+        return entry;
+    }
+
+    // Chunk by ID, taken from the image's chunk table the first time it is
+    // used; nullptr if there is no such chunk (caller holds storeMutex)
+    Chunk* findChunk(uint64_t id) {
+        auto it = chunks.find(id);
+        if (it != chunks.end()) {
+            return &it->second;
+        }
+        const ImageChunk* entry = imageChunk(id);
+        if (!entry) {
+            return nullptr;
+        }
+        Chunk& chunk = chunks[id];
+        chunk.segment = entry->segment;
+        chunk.length = entry->length;
+        chunk.offset = entry->offset;
+        chunk.refCount = static_cast<int>(entry->refCount); // The image's records hold these until they are loaded
+        physicalBytes += chunk.length;
+        return &chunk;
+    }
+
+    // Garbage share of a sealed segment, or 0 for the active one
+    double garbageRatio(uint32_t id, const ContentSegment& segment) const {
+        if (id == activeSegment || segment.bytes == 0) {
+            return 0;
+        }
+        return static_cast<double>(segment.bytes - segment.liveBytes) / segment.bytes;
+    }
+
+    // Give a chunk a place for its bytes: the end of the active segment,
+    // or memory if no segment can be written (caller holds storeMutex)
+    void placeChunk(Chunk& chunk, const char* data) {
+        if (activeSegment != IN_MEMORY_SEGMENT && segments[activeSegment].bytes + chunk.length > CONTENT_SEGMENT_MAX_BYTES) {
+            sealActive();
+        }
+        if (activeSegment == IN_MEMORY_SEGMENT) {
+            string path = segmentPrefix + to_string(nextSegmentId) + ".seg";
+            int fd = createSegmentFile(path);
+            while (fd < 0 && errno == EEXIST) {
+                nextSegmentId++; // Left by an earlier run and possibly still needed; never overwrite it
+                path = segmentPrefix + to_string(nextSegmentId) + ".seg";
+                fd = createSegmentFile(path);
+            }
+            if (fd >= 0) {
+                activeSegment = nextSegmentId++;
+                segments[activeSegment] = { path, fd, 0, 0, true, 0, 0, true, false };
+                flushedBytes = 0;
+            }
+        }
+        if (activeSegment == IN_MEMORY_SEGMENT) {
+            chunk.segment = IN_MEMORY_SEGMENT;
+            chunk.data.assign(data, chunk.length);
+            return;
+        }
+        ContentSegment& segment = segments[activeSegment];
+        chunk.segment = activeSegment;
+        chunk.offset = segment.bytes;
+        chunk.data.clear();
+        writeBuffer.append(data, chunk.length);
+        segment.bytes += chunk.length;
+        segment.liveBytes += chunk.length;
+        if (writeBuffer.length() >= CONTENT_WRITE_BUFFER_BYTES) {
+            flushActive();
+        }
+    }
+
+    // Copy a chunk's bytes into `buffer` (caller holds storeMutex)
+    bool readChunk(const Chunk& chunk, char* buffer) const {
+        if (chunk.segment == IN_MEMORY_SEGMENT) {
+            memcpy(buffer, chunk.data.data(), chunk.length);
+            return true;
+        }
+        if (chunk.segment == activeSegment && chunk.offset >= flushedBytes) {
+            memcpy(buffer, writeBuffer.data() + (chunk.offset - flushedBytes), chunk.length);
+            return true;
+        }
+        return readAt(segments.at(chunk.segment).fd, chunk.offset, buffer, chunk.length);
+    }
+
+    // Store one chunk (or add a reference to an identical one) and return its ID
+    uint64_t retainChunk(const char* data, size_t length) {
+        uint64_t id = hashBytes(data, length);
+        while (true) {
+            Chunk* existing = findChunk(id);
+            if (!existing) {
+                Chunk& chunk = chunks[id];
+                chunk.length = static_cast<uint32_t>(length);
+                chunk.refCount = 1;
+                placeChunk(chunk, data);
+                physicalBytes += length;
+                return id;
+            }
+            scratch.resize(existing->length);
+            if (existing->length == length && readChunk(*existing, &scratch[0]) && memcmp(scratch.data(), data, length) == 0) {
+                existing->refCount++;
+                return id;
+            }
+            id++; // Hash collision with different bytes, probe the next ID
+        }
+    }
+
+    // Background compactor: empty the sealed segment with the most garbage
+    // once it is over COMPACTION_GARBAGE_RATIO, by moving its live chunks to
+    // the active segment, then delete it. Segments being read are left alone.
+    void compactorLoop() {
+        unique_lock<mutex> lock(storeMutex);
+        while (!stopping) {
+            uint32_t victim = IN_MEMORY_SEGMENT;
+            double worst = COMPACTION_GARBAGE_RATIO;
+            for (const auto& segment : segments) {
+                double ratio = garbageRatio(segment.first, segment.second);
+                if (segment.second.compactable && segment.second.pins == 0 && ratio >= worst) {
+                    victim = segment.first;
+                    worst = ratio;
+                }
+            }
+            if (victim == IN_MEMORY_SEGMENT) {
+                compactorWake.wait(lock);
+                continue;
+            }
+
+            vector<uint64_t> live;
+            for (const auto& entry : chunks) {
+                if (entry.second.segment == victim) {
+                    live.push_back(entry.first);
+                }
+            }
+            for (size_t i = 0; i < imageChunkCount; i++) {
+                const ImageChunk& entry = imageChunks[i];
+                if (entry.segment == victim && !chunks.count(entry.id) && !discarded.count(entry.id)) {
+                    live.push_back(entry.id); // Only referenced by image records not loaded yet
+                }
+            }
+            string bytes;
+            for (size_t i = 0; i < live.size() && !stopping; i++) {
+                Chunk* chunk = findChunk(live[i]);
+                auto segment = segments.find(victim);
+                if (segment == segments.end()) {
+                    break; // Every chunk in it was released meanwhile
+                }
+                if (chunk && chunk->segment == victim) {
+                    bytes.resize(chunk->length);
+                    if (readChunk(*chunk, &bytes[0])) {
+                        segment->second.liveBytes -= chunk->length;
+                        placeChunk(*chunk, bytes.data());
+                        relocatedBytes += chunk->length;
+                    }
+                }
+                if ((i + 1) % COMPACTION_BATCH_SIZE == 0) {
+                    lock.unlock(); // Let foreground operations in between batches
+                    this_thread::yield();
+                    lock.lock();
+                }
+            }
+            auto segment = segments.find(victim);
+            if (segment != segments.end()) {
+                if (segment->second.liveBytes == 0) {
+                    dropSegment(victim);
+                    compactions++;
+                } else if (!stopping) {
+                    segment->second.compactable = false; // Some chunks could not be read; leave it
+                }
+            } else {
+                compactions++;
+            }
+        }
+    }
+
+public:
+    BlobStore(const string& prefix = "content_")
+    {
+        uint64_t seed = 0;
+        for (int i = 0; i < 256; i++) {
+            seed += 0x9e3779b97f4a7c15ULL;
+            gear[i] = mixHash(seed);
+        }
+        logicalBytes = physicalBytes = 0;
+        segmentPrefix = prefix;
+        imageChunks = nullptr;
+        imageChunkCount = 0;
+        durable = detached = false;
+        activeSegment = IN_MEMORY_SEGMENT;
+        nextSegmentId = 1;
+        flushedBytes = 0;
+        compactions = 0;
+        relocatedBytes = 0;
+        stopping = false;
+        compactor = thread(&BlobStore::compactorLoop, this);
+    }
+
+    // Stop the compactor and close the segment files. Without persistence
+    // the segments this run made are deleted; with it they are kept.
+    ~BlobStore() {
+        {
+            lock_guard<mutex> lock(storeMutex);
+            stopping = true;
+        }
+        compactorWake.notify_all();
+        compactor.join();
+        if (durable) {
+            sync();
+        }
+        for (auto& segment : segments) {
+            closeSegment(segment.second);
+        }
+        for (auto& segment : retiredSegments) {
+            closeSegment(segment.second);
+        }
+    }
+
+    // Keep segment files across runs (persistence on) or delete the ones this run made when done
+    void keepSegments(bool keep) {
+        lock_guard<mutex> lock(storeMutex);
+        durable = keep;
+        detached = false;
+    }
+
+    // Let go of the image when the file system shuts down. With persistence
+    // the segments are also synced and closed first, so releasing the last
+    // references neither compacts nor deletes what the image and the log use.
+    void detach() {
+        bool synced = durable && sync();
+        lock_guard<mutex> lock(storeMutex);
+        imageChunks = nullptr;
+        imageChunkCount = 0;
+        discarded.clear();
+        if (!synced) {
+            return; // Without persistence, or with chunks that never reached a segment
+        }
+        for (auto* table : { &segments, &retiredSegments }) {
+            for (auto& entry : *table) {
+                closeSegment(entry.second);
+            }
+            table->clear();
+        }
+        activeSegment = IN_MEMORY_SEGMENT;
+        detached = true;
+    }
+
+    // Take over the segments of a namespace image loaded at startup. Its
+    // chunks are looked up in its chunk table when they are first used.
+    void attachImage(const ImageChunk* table, size_t count, const ImageSegment* segmentTable, size_t segmentCount, uint32_t nextId) {
+        lock_guard<mutex> lock(storeMutex);
+        for (const auto& entry : chunks) {
+            physicalBytes -= entry.second.length; // Held only by records an earlier file system left in its image
+        }
+        chunks.clear(); // This image's table counts their references afresh
+        imageChunks = table;
+        imageChunkCount = count;
+        discarded.clear();
+        nextSegmentId = max(nextSegmentId, nextId);
+        for (size_t i = 0; i < segmentCount; i++) {
+            openSegment(segmentTable[i].id).liveBytes = segmentTable[i].liveBytes;
+        }
+    }
+
+    // Switch to the chunk table of a newly mapped image: one just written by
+    // a checkpoint (it matches the store), or the old one mapped again
+    void remapImage(const ImageChunk* table, size_t count, bool written) {
+        lock_guard<mutex> lock(storeMutex);
+        imageChunks = table;
+        imageChunkCount = count;
+        if (written) {
+            discarded.clear();
+        }
+    }
+
+    // Write the buffered tail of the active segment and fsync every segment
+    // that grew, so everything stored so far survives a crash. False on failure.
+    bool sync() {
+        vector<pair<uint32_t, uint64_t>> dirty; // Segment -> bytes covered by this sync
+        vector<int> files;
+        {
+            lock_guard<mutex> lock(storeMutex);
+            uint32_t active = activeSegment;
+            flushActive();
+            if (active != activeSegment) {
+                return false; // The flush failed; chunks in the buffer never reached their segment
+            }
+            for (auto* table : { &segments, &retiredSegments }) {
+                for (auto& entry : *table) {
+                    ContentSegment& segment = entry.second;
+                    if (segment.fd >= 0 && segment.syncedBytes < segment.bytes) {
+                        segment.pins++;
+                        dirty.emplace_back(entry.first, segment.bytes);
+                        files.push_back(segment.fd);
+                    }
+                }
+            }
+        }
+        bool synced = true;
+        for (int fd : files) {
+            synced = syncSegmentFile(fd) && synced;
+        }
+        lock_guard<mutex> lock(storeMutex);
+        for (const auto& entry : dirty) {
+            auto it = segments.find(entry.first);
+            if (it == segments.end()) {
+                it = retiredSegments.find(entry.first);
+            }
+            if (synced) {
+                it->second.syncedBytes = max(it->second.syncedBytes, entry.second);
+            }
+            unpinSegment(entry.first);
+        }
+        return synced;
+    }
+
+    // Copy the chunk and segment tables for a new namespace image, with every
+    // chunk in a segment on disk. `expiring` gets the retired segments the
+    // image will not refer to; they can go once it replaces the old image
+    // and the log. False if some chunk could not be written.
+    bool snapshot(vector<ImageChunk>& chunkTable, vector<ImageSegment>& segmentTable, uint32_t& nextId, vector<uint32_t>& expiring) {
+        {
+            lock_guard<mutex> lock(storeMutex);
+            for (auto& entry : chunks) {
+                Chunk& chunk = entry.second;
+                if (chunk.segment == IN_MEMORY_SEGMENT) {
+                    string data;
+                    data.swap(chunk.data);
+                    placeChunk(chunk, data.data()); // Kept in memory again if no segment can be written
+                }
+            }
+            flushActive();
+            chunkTable.clear();
+            for (size_t i = 0; i < imageChunkCount; i++) {
+                if (!chunks.count(imageChunks[i].id) && !discarded.count(imageChunks[i].id)) {
+                    chunkTable.push_back(imageChunks[i]); // Untouched since the last image
+                }
+            }
+            for (const auto& entry : chunks) {
+                const Chunk& chunk = entry.second;
+                if (chunk.segment == IN_MEMORY_SEGMENT) {
+                    return false;
+                }
+                chunkTable.push_back({ entry.first, chunk.offset, chunk.segment, chunk.length, static_cast<uint64_t>(chunk.refCount) });
+            }
+            sort(chunkTable.begin(), chunkTable.end(), [](const ImageChunk& a, const ImageChunk& b) { return a.id < b.id; });
+            segmentTable.clear();
+            for (const auto& entry : segments) {
+                segmentTable.push_back({ entry.first, 0, entry.second.bytes, entry.second.liveBytes });
+            }
+            nextId = nextSegmentId;
+            expiring.clear();
+            for (const auto& entry : retiredSegments) {
+                expiring.push_back(entry.first);
+            }
+        }
+        return sync();
+    }
+
+    // Delete retired segments that a new image and an emptied log no longer refer to
+    void expire(const vector<uint32_t>& ids) {
+        lock_guard<mutex> lock(storeMutex);
+        for (uint32_t id : ids) {
+            auto it = retiredSegments.find(id);
+            if (it == retiredSegments.end()) {
+                continue;
+            }
+            it->second.expired = true;
+            if (it->second.pins == 0) {
+                closeSegment(it->second);
+                retiredSegments.erase(it);
+            }
+        }
+    }
+
+    // Split content into chunks at content-defined boundaries and store them
+    vector<uint64_t> store(const string& content) {
+        lock_guard<mutex> lock(storeMutex);
+        vector<uint64_t> ids;
+        size_t start = 0;
+        uint64_t h = 0;
+        for (size_t i = 0; i < content.length(); i++) {
+            h = (h << 1) + gear[static_cast<unsigned char>(content[i])];
+            size_t length = i + 1 - start;
+            if ((length >= CHUNK_MIN_SIZE && (h & CHUNK_BOUNDARY_MASK) == 0) || length >= CHUNK_MAX_SIZE) {
+                ids.push_back(retainChunk(content.data() + start, length));
+                start = i + 1;
+                h = 0;
+            }
+        }
+        if (start < content.length()) {
+            ids.push_back(retainChunk(content.data() + start, content.length() - start));
+        }
+        logicalBytes += content.length();
+        return ids;
+    }
+
+    // Add a reference to every chunk of an existing blob; false if a chunk is unknown
+    bool retain(const vector<uint64_t>& ids, size_t length) {
+        lock_guard<mutex> lock(storeMutex);
+        for (uint64_t id : ids) {
+            if (!findChunk(id)) {
+                return false;
+            }
+        }
+        for (uint64_t id : ids) {
+            chunks[id].refCount++;
+        }
+        logicalBytes += length;
+        return true;
+    }
+
+    // Take over references to a blob's chunks that are counted in the
+    // image's chunk table (held by a record being loaded); false if a chunk is unknown
+    bool adopt(const vector<uint64_t>& ids, size_t length) {
+        lock_guard<mutex> lock(storeMutex);
+        for (uint64_t id : ids) {
+            if (!findChunk(id)) {
+                return false;
+            }
+        }
+        logicalBytes += length;
+        return true;
+    }
+
+    // Encode a blob's chunk references with their current locations, for
+    // the write-ahead log (chunks kept in memory carry their bytes)
+    string exportReferences(const vector<uint64_t>& ids) {
+        lock_guard<mutex> lock(storeMutex);
+        ostringstream out;
+        writeBinary<uint32_t>(out, static_cast<uint32_t>(ids.size()));
+        for (uint64_t id : ids) {
+            const Chunk& chunk = chunks.at(id);
+            writeBinary<uint64_t>(out, id);
+            writeBinary<uint32_t>(out, chunk.segment);
+            writeBinary<uint32_t>(out, chunk.length);
+            writeBinary<uint64_t>(out, chunk.offset);
+            if (chunk.segment == IN_MEMORY_SEGMENT) {
+                out.write(chunk.data.data(), chunk.length);
+            }
+        }
+        return out.str();
+    }
+
+    // Take a reference to every chunk of a blob encoded by exportReferences.
+    // A chunk the store does not know (stored after the last checkpoint) is
+    // registered at its logged location. False if the encoding is damaged.
+    bool importReferences(const string& encoded, vector<uint64_t>& ids, size_t& length) {
+        struct LoggedChunk {
+            uint64_t id;
+            uint32_t segment;
+            uint32_t length;
+            uint64_t offset;
+            string data; // Bytes of a chunk that was kept in memory
+        };
+        istringstream in(encoded);
+        uint32_t count;
+        if (!readBinary(in, count)) {
+            return false;
+        }
+        vector<LoggedChunk> logged;
+        for (uint32_t i = 0; i < count; i++) {
+            LoggedChunk entry;
+            if (!readBinary(in, entry.id) || !readBinary(in, entry.segment) || !readBinary(in, entry.length) || !readBinary(in, entry.offset)) {
+                return false;
+            }
+            if (entry.segment == IN_MEMORY_SEGMENT) {
+                entry.data.resize(entry.length);
+                if (!in.read(&entry.data[0], entry.length)) {
+                    return false;
+                }
+            }
+            logged.push_back(move(entry));
+        }
+        lock_guard<mutex> lock(storeMutex);
+        ids.clear();
+        length = 0;
+        for (const LoggedChunk& entry : logged) {
+            Chunk* chunk = findChunk(entry.id);
+            if (!chunk) {
+                Chunk& added = chunks[entry.id];
+                added.length = entry.length;
+                added.refCount = 0;
+                if (entry.segment == IN_MEMORY_SEGMENT) {
+                    placeChunk(added, entry.data.data());
+                } else {
+                    ContentSegment& file = openSegment(entry.segment);
+                    file.liveBytes += entry.length;
+                    file.bytes = max(file.bytes, entry.offset + entry.length);
+                    added.segment = entry.segment;
+                    added.offset = entry.offset;
+                }
+                physicalBytes += entry.length;
+                chunk = &added;
+            }
+            chunk->refCount++;
+            ids.push_back(entry.id);
+            length += entry.length;
+        }
+        logicalBytes += length;
+        return true;
+    }
+
+    // Drop a reference to every chunk of a blob, freeing chunks nobody uses
+    void release(const vector<uint64_t>& ids, size_t length) {
+        lock_guard<mutex> lock(storeMutex);
+        for (uint64_t id : ids) {
+            auto it = chunks.find(id);
+            if (--it->second.refCount > 0) {
+                continue;
+            }
+            const Chunk& chunk = it->second;
+            if (imageChunk(id)) {
+                discarded.insert(id); // The image's table still lists it
+            }
+            physicalBytes -= chunk.length;
+            auto found = segments.end();
+            if (chunk.segment != IN_MEMORY_SEGMENT && !detached) {
+                found = segments.find(chunk.segment); // Not there if it was already dropped or compacted away
+            }
+            if (found != segments.end()) {
+                ContentSegment& segment = found->second;
+                segment.liveBytes -= min<uint64_t>(segment.liveBytes, chunk.length);
+                if (chunk.segment != activeSegment) {
+                    if (segment.liveBytes == 0) {
+                        dropSegment(chunk.segment);
+                    } else if (garbageRatio(chunk.segment, segment) >= COMPACTION_GARBAGE_RATIO) {
+                        compactorWake.notify_one();
+                    }
+                }
+            }
+            chunks.erase(it);
+        }
+        logicalBytes -= length;
+    }
+
+    // Reassemble the content of a blob
+    string read(const vector<uint64_t>& ids, size_t length) const {
+        lock_guard<mutex> lock(storeMutex);
+        string content(length, '\0');
+        size_t position = 0;
+        for (uint64_t id : ids) {
+            const Chunk& chunk = chunks.at(id);
+            if (!readChunk(chunk, &content[position])) {
+                content.resize(position); // Segment unreadable; return what could be read
+                break;
+            }
+            position += chunk.length;
+        }
+        return content;
+    }
+
+    // Send the content of a blob to a descriptor chunk by chunk, straight
+    // from the segment files, without reassembling it in memory. Chunk
+    // locations are copied under storeMutex and their segments pinned, so the
+    // transfer itself runs without the lock and the files cannot go away.
+    bool streamTo(int fd, const vector<uint64_t>& ids) {
+        struct Piece {
+            uint32_t segment;
+            int segmentFd;
+            uint64_t offset;
+            uint32_t length;
+            string data; // Bytes of a chunk kept in memory
+        };
+        vector<Piece> pieces;
+        vector<uint32_t> pinned;
+        {
+            lock_guard<mutex> lock(storeMutex);
+            flushActive();
+            pieces.reserve(ids.size());
+            for (uint64_t id : ids) {
+                const Chunk& chunk = chunks.at(id);
+                if (chunk.segment == IN_MEMORY_SEGMENT) {
+                    pieces.push_back({ IN_MEMORY_SEGMENT, -1, 0, chunk.length, chunk.data });
+                    continue;
+                }
+                ContentSegment& segment = segments.at(chunk.segment);
+                if (find(pinned.begin(), pinned.end(), chunk.segment) == pinned.end()) {
+                    segment.pins++; // Once per segment and transfer
+                    pinned.push_back(chunk.segment);
+                }
+                pieces.push_back({ chunk.segment, segment.fd, chunk.offset, chunk.length, string() });
+            }
+        }
+
+        bool sent = true;
+        for (size_t i = 0; i < pieces.size() && sent; i++) {
+            const Piece& piece = pieces[i];
+            sent = piece.segment == IN_MEMORY_SEGMENT ? writeAll(fd, piece.data.data(), piece.length)
+                                                      : copyRange(piece.segmentFd, piece.offset, piece.length, fd);
+        }
+
+        lock_guard<mutex> lock(storeMutex);
+        for (uint32_t id : pinned) {
+            unpinSegment(id);
+        }
+        return sent;
+    }
+
+    // Display deduplication and segment statistics
+    // `unloadedBytes` is the content of the records not loaded from the
+    // image yet; the chunks only they use are counted from its chunk table
+    void displayStats(uint64_t unloadedBytes = 0) const {
+        lock_guard<mutex> lock(storeMutex);
+        uint64_t segmentBytes = 0, liveBytes = 0;
+        for (const auto& segment : segments) {
+            segmentBytes += segment.second.bytes;
+            liveBytes += segment.second.liveBytes;
+        }
+        size_t uniqueChunks = chunks.size();
+        uint64_t logical = logicalBytes + unloadedBytes, physical = physicalBytes;
+        for (size_t i = 0; i < imageChunkCount; i++) {
+            if (!chunks.count(imageChunks[i].id) && !discarded.count(imageChunks[i].id)) {
+                uniqueChunks++;
+                physical += imageChunks[i].length;
+            }
+        }
+        cout << CYAN << "Content Store Statistics:" << RESET << endl;
+        cout << YELLOW << "Unique chunks: " << uniqueChunks
+             << "\nLogical bytes: " << logical
+             << "\nStored bytes: " << physical;
+        if (physical > 0) {
+            cout << "\nDedup ratio: " << static_cast<double>(logical) / physical << "x";
+        }
+        cout << "\nContent segments: " << segments.size() << " (" << segmentBytes << " bytes on disk";
+        if (segmentBytes > 0) {
+            cout << ", " << 100.0 * (segmentBytes - liveBytes) / segmentBytes << "% garbage";
+        }
+        cout << ")\nCompactions: " << compactions << " (" << relocatedBytes << " bytes relocated)";
+        cout << RESET << endl;
+    }
+};
+
+BlobStore blobStore; // Shared store behind every file version, file and recycle bin entry
+
+// How a saved record refers to its content
+enum class ContentRefs {
+    Inline,  // The bytes themselves (images written before content segments were kept)
+    Counted, // Chunk IDs whose references are counted in the image's chunk table
+    Held     // Chunk IDs kept alive by the record's owner (a spilled recycle bin entry)
+};
+
+// Handle to content kept in the blob store; copies share the same chunks
+class Blob
+{
+private:
+    vector<uint64_t> chunkIds;
+    size_t length;
+
+public:
+    Blob() : length(0) {}
+
+    Blob(const string& content) : chunkIds(blobStore.store(content)), length(content.length()) {}
+
+    Blob(const Blob& other) : chunkIds(other.chunkIds), length(other.length) {
+        blobStore.retain(chunkIds, length);
+    }
+
+    Blob& operator=(const Blob& other) {
+        if (this != &other) {
+            blobStore.retain(other.chunkIds, other.length);
+            blobStore.release(chunkIds, length);
+            chunkIds = other.chunkIds;
+            length = other.length;
+        }
+        return *this;
+    }
+
+    Blob(Blob&& other) noexcept : chunkIds(move(other.chunkIds)), length(other.length) {
+        other.chunkIds.clear();
+        other.length = 0;
+    }
+
+    Blob& operator=(Blob&& other) noexcept {
+        if (this != &other) {
+            blobStore.release(chunkIds, length);
+            chunkIds = move(other.chunkIds);
+            length = other.length;
+            other.chunkIds.clear();
+            other.length = 0;
+        }
+        return *this;
+    }
+
+    ~Blob() {
+        blobStore.release(chunkIds, length);
+    }
+
+    size_t size() const {
+        return length;
+    }
+
+    string str() const {
+        return blobStore.read(chunkIds, length);
+    }
+
+    // Write the content to a descriptor without building it in memory
+    bool writeTo(int fd) const {
+        return blobStore.streamTo(fd, chunkIds);
+    }
+
+    // Save the chunk references (the bytes stay in the content segments)
+    void save(ostream& out) const {
+        writeBinary<uint64_t>(out, length);
+        writeBinary<uint32_t>(out, static_cast<uint32_t>(chunkIds.size()));
+        for (uint64_t id : chunkIds) {
+            writeBinary<uint64_t>(out, id);
+        }
+    }
+
+    // Read content saved by save(), or the bytes themselves for Inline
+    // records. False if the record is damaged or refers to unknown chunks.
+    static bool load(istream& in, ContentRefs refs, Blob& blob) {
+        if (refs == ContentRefs::Inline) {
+            string content;
+            if (!readBinaryString(in, content)) {
+                return false;
+            }
+            blob = Blob(content);
+            return true;
+        }
+        uint64_t length;
+        uint32_t count;
+        if (!readBinary(in, length) || !readBinary(in, count) || count > length) {
+            return false; // Chunks are never empty
+        }
+        vector<uint64_t> ids(count);
+        for (uint64_t& id : ids) {
+            if (!readBinary(in, id)) {
+                return false;
+            }
+        }
+        size_t size = static_cast<size_t>(length);
+        if (refs == ContentRefs::Counted ? !blobStore.adopt(ids, size) : !blobStore.retain(ids, size)) {
+            return false;
+        }
+        blob = Blob();
+        blob.chunkIds = move(ids);
+        blob.length = size;
+        return true;
+    }
+
+    // Chunk references with their locations, for a write-ahead log record
+    string references() const {
+        return blobStore.exportReferences(chunkIds);
+    }
+
+    // Content logged by references(); false if the record is damaged
+    static bool fromReferences(const string& encoded, Blob& blob) {
+        Blob logged;
+        if (!blobStore.importReferences(encoded, logged.chunkIds, logged.length)) {
+            return false;
+        }
+        blob = move(logged);
+        return true;
+    }
+};
+
+// Force a file's written data to stable storage
+bool syncToDisk(FILE* file) {
+#ifdef _WIN32
+    return _commit(_fileno(file)) == 0;
+#else
+    return fsync(fileno(file)) == 0;
+#endif
+}
+
+// Force a closed file to stable storage
+bool syncToDisk(const string& path) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+    bool synced = syncToDisk(file);
+    fclose(file);
+    return synced;
+}
+
+// ID of this process, used to keep scratch files of concurrent runs apart
+long processId() {
+#ifdef _WIN32
+    return static_cast<long>(_getpid());
+#else
+    return static_cast<long>(getpid());
+#endif
+}
+
+// Atomically replace `target` with `source` (a crash leaves one or the other)
+bool replaceFile(const string& source, const string& target) {
+#ifdef _WIN32
+    remove(target.c_str()); // rename() does not overwrite on Windows
+#endif
+    return rename(source.c_str(), target.c_str()) == 0;
+}
+
+// Read-only input stream buffer over bytes already in memory (e.g. part of a
+// mapped image), so binary records can be parsed in place without copying
+class MemoryBuffer : public streambuf
+{
+public:
+    MemoryBuffer(const char* data, size_t length) {
+        char* begin = const_cast<char*>(data);
+        setg(begin, begin, begin + length);
+    }
+
+protected:
+    // Lets tellg() report the position and seekg() skip records unread
+    pos_type seekoff(off_type offset, ios_base::seekdir direction, ios_base::openmode) override {
+        char* origin = direction == ios_base::beg ? eback() : direction == ios_base::cur ? gptr() : egptr();
+        if (offset < eback() - origin || offset > egptr() - origin) {
+            return pos_type(off_type(-1));
+        }
+        setg(eback(), origin + offset, egptr());
+        return pos_type(gptr() - eback());
+    }
+
+    pos_type seekpos(pos_type position, ios_base::openmode which) override {
+        return seekoff(off_type(position), ios_base::beg, which);
+    }
+};
+
+// Layout of the namespace image. Every reference is an offset from the
+// start of the file, so the image can be mapped at any address and used
+// in place. Folders are stored breadth-first with the root first; the
+// children of a folder are consecutive, so a folder only records its first
+// child. Each folder's files are one block of file records.
+// The content of every version is a list of chunk IDs, resolved through
+// the chunk table that follows the header (ImageContentTables).
+const char IMAGE_MAGIC[16] = "GDRIVE-IMAGE-5";
+const char UNSIZED_BIN_IMAGE_MAGIC[16] = "GDRIVE-IMAGE-4"; // Recycle bin entries without the length of their file record
+const char INLINE_IMAGE_MAGIC[16] = "GDRIVE-IMAGE-3";    // Content stored inline, no content tables
+const char PLAINTEXT_IMAGE_MAGIC[16] = "GDRIVE-IMAGE-2"; // As above, and accounts saved with plaintext credentials
+
+struct ImageHeader {
+    char magic[16];
+    uint64_t lsn;                // Last log record included
+    uint64_t lastFileId;
+    uint64_t lastFolderId;
+    int64_t retention;           // Recycle bin retention in seconds
+    uint64_t folderCount;
+    uint64_t fileCount;
+    uint64_t folderTableOffset;  // ImageFolder[folderCount]
+    uint64_t tailOffset;         // Users, groups, shares and the recycle bin (record stream)
+    uint64_t tailBytes;
+};
+
+struct ImageFolder {
+    uint64_t id;
+    uint64_t nameOffset;
+    uint32_t nameLength;
+    uint32_t childCount;
+    uint64_t firstChild;  // Index of the first child in the folder table
+    uint64_t filesOffset; // Block of saveFileNode records
+    uint64_t filesBytes;
+    uint64_t fileCount;
+};
+
+// Follows the header in images without inline content
+struct ImageContentTables {
+    uint64_t chunkTableOffset;   // ImageChunk[chunkCount]
+    uint64_t chunkCount;
+    uint64_t segmentTableOffset; // ImageSegment[segmentCount], the content segments in use
+    uint64_t segmentCount;
+    uint32_t nextSegmentId;      // Lowest segment number never handed out
+    uint32_t reserved;
+};
+
+static_assert(sizeof(ImageHeader) == 88 && sizeof(ImageFolder) == 56 && sizeof(ImageContentTables) == 40, "image records must not change size");
+
+// A namespace image mapped read-only into memory. Pages are only read from
+// disk when a folder that lives on them is first used.
+class MappedImage
+{
+private:
+    const char* base;
+    size_t length;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#else
+    int fd;
+#endif
+
+    bool inRange(uint64_t offset, uint64_t bytes) const {
+        return offset <= length && bytes <= length - offset;
+    }
+
+public:
+    MappedImage() : base(nullptr), length(0) {
+#ifdef _WIN32
+        file = INVALID_HANDLE_VALUE;
+        mapping = nullptr;
+#else
+        fd = -1;
+#endif
+    }
+
+    ~MappedImage() {
+        close();
+    }
+
+    MappedImage(const MappedImage&) = delete;
+    MappedImage& operator=(const MappedImage&) = delete;
+
+    // Map an image file; false if it is missing, empty or not a valid image
+    bool open(const string& path) {
+        close();
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        LARGE_INTEGER size;
+        if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+            close();
+            return false;
+        }
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        void* address = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+        if (!address) {
+            close();
+            return false;
+        }
+        length = static_cast<size_t>(size.QuadPart);
+#else
+        fd = ::open(path.c_str(), O_RDONLY);
+        struct stat info;
+        if (fd < 0 || fstat(fd, &info) != 0 || info.st_size == 0) {
+            close();
+            return false;
+        }
+        void* address = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_SHARED, fd, 0);
+        if (address == MAP_FAILED) {
+            close();
+            return false;
+        }
+        length = static_cast<size_t>(info.st_size);
+#endif
+        base = static_cast<const char*>(address);
+        const ImageHeader& head = header();
+        if (length < sizeof(ImageHeader) || (!sizedBinRecords() && !inlineContent() && memcmp(head.magic, UNSIZED_BIN_IMAGE_MAGIC, sizeof(UNSIZED_BIN_IMAGE_MAGIC)) != 0) || head.folderCount == 0 ||
+            head.folderCount > length / sizeof(ImageFolder) ||
+            !inRange(head.folderTableOffset, head.folderCount * sizeof(ImageFolder)) || !inRange(head.tailOffset, head.tailBytes)) {
+            close();
+            return false;
+        }
+        if (!inlineContent()) {
+            const ImageContentTables* tables = length < sizeof(ImageHeader) + sizeof(ImageContentTables) ? nullptr : &contentTables();
+            if (!tables || tables->chunkCount > length / sizeof(ImageChunk) || tables->segmentCount > length / sizeof(ImageSegment) ||
+                tables->chunkTableOffset % alignof(ImageChunk) != 0 || tables->segmentTableOffset % alignof(ImageSegment) != 0 ||
+                !inRange(tables->chunkTableOffset, tables->chunkCount * sizeof(ImageChunk)) ||
+                !inRange(tables->segmentTableOffset, tables->segmentCount * sizeof(ImageSegment))) {
+                close();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void close() {
+#ifdef _WIN32
+        if (base) UnmapViewOfFile(base);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (base) munmap(const_cast<char*>(base), length);
+        if (fd >= 0) ::close(fd);
+        fd = -1;
+#endif
+        base = nullptr;
+        length = 0;
+    }
+
+    bool isOpen() const { return base != nullptr; }
+
+    const ImageHeader& header() const {
+        return *reinterpret_cast<const ImageHeader*>(base);
+    }
+
+    // Whether the image was written before credentials were hashed
+    bool plaintextCredentials() const {
+        return memcmp(header().magic, PLAINTEXT_IMAGE_MAGIC, sizeof(PLAINTEXT_IMAGE_MAGIC)) == 0;
+    }
+
+    // Whether the image was written before content segments were kept, so
+    // its records hold the content itself and it has no content tables
+    bool inlineContent() const {
+        return plaintextCredentials() || memcmp(header().magic, INLINE_IMAGE_MAGIC, sizeof(INLINE_IMAGE_MAGIC)) == 0;
+    }
+
+    // Whether each recycle bin entry records the length of its file record,
+    // so the entry can be kept without reading the record
+    bool sizedBinRecords() const {
+        return memcmp(header().magic, IMAGE_MAGIC, sizeof(IMAGE_MAGIC)) == 0;
+    }
+
+    // How the image's file records refer to their content
+    ContentRefs contentRefs() const {
+        return inlineContent() ? ContentRefs::Inline : ContentRefs::Counted;
+    }
+
+    const ImageContentTables& contentTables() const {
+        return *reinterpret_cast<const ImageContentTables*>(base + sizeof(ImageHeader));
+    }
+
+    // Chunk table (nullptr for images with inline content)
+    const ImageChunk* chunkTable() const {
+        return inlineContent() ? nullptr : reinterpret_cast<const ImageChunk*>(base + contentTables().chunkTableOffset);
+    }
+
+    size_t chunkCount() const {
+        return inlineContent() ? 0 : static_cast<size_t>(contentTables().chunkCount);
+    }
+
+    const ImageSegment* segmentTable() const {
+        return inlineContent() ? nullptr : reinterpret_cast<const ImageSegment*>(base + contentTables().segmentTableOffset);
+    }
+
+    size_t segmentCount() const {
+        return inlineContent() ? 0 : static_cast<size_t>(contentTables().segmentCount);
+    }
+
+    // Folder record by index, or nullptr if the index or its ranges are out of bounds
+    const ImageFolder* folder(uint64_t index) const {
+        const ImageHeader& head = header();
+        if (index >= head.folderCount) {
+            return nullptr;
+        }
+        const ImageFolder* record = reinterpret_cast<const ImageFolder*>(base + head.folderTableOffset) + index;
+        if (!inRange(record->nameOffset, record->nameLength) || !inRange(record->filesOffset, record->filesBytes) ||
+            record->firstChild + record->childCount > head.folderCount) {
+            return nullptr;
+        }
+        return record;
+    }
+
+    string_view name(const ImageFolder& record) const {
+        return string_view(base + record.nameOffset, record.nameLength);
+    }
+
+    const char* at(uint64_t offset) const {
+        return base + offset;
+    }
+};
+
+// Locking policy for pools only the main thread uses
+struct NoPoolLock {
+    void lock() {}
+    void unlock() {}
+};
+
+// Slab allocator for one node type: nodes are carved out of large slabs and
+// freed slots are kept on a free list for reuse, so building or tearing down
+// big structures never goes through the general-purpose heap per node.
+// Lock is `mutex` for pools another thread also frees into, else NoPoolLock.
+template <typename T, typename Lock = NoPoolLock>
+class NodePool
+{
+private:
+    union Slot {
+        Slot* nextFree;                             // Link while the slot is free
+        alignas(T) unsigned char storage[sizeof(T)]; // Node while the slot is used
+    };
+    static const size_t SLAB_SLOTS = 1024;
+
+    vector<Slot*> slabs; // All slabs owned by the pool
+    Slot* freeList;      // Slots released by destroy()
+    size_t slabUsed;     // Slots handed out from the newest slab
+    size_t liveNodes;    // Nodes currently constructed
+    mutable Lock poolMutex;
+
+public:
+    NodePool() : freeList(nullptr), slabUsed(SLAB_SLOTS), liveNodes(0) {}
+
+    NodePool(const NodePool&) = delete;
+    NodePool& operator=(const NodePool&) = delete;
+
+    // Releases the slabs; owners are expected to have destroyed their nodes
+    ~NodePool() {
+        for (Slot* slab : slabs) {
+            delete[] slab;
+        }
+    }
+
+    // Construct a node in a free slot (aggregate initialization)
+    template <typename... Args>
+    T* create(Args&&... args) {
+        unique_lock<Lock> lock(poolMutex);
+        Slot* slot = freeList;
+        if (slot) {
+            freeList = slot->nextFree;
+        } else {
+            if (slabUsed == SLAB_SLOTS) {
+                slabs.push_back(new Slot[SLAB_SLOTS]);
+                slabUsed = 0;
+            }
+            slot = &slabs.back()[slabUsed++];
+        }
+        liveNodes++;
+        lock.unlock();
+        return new (slot->storage) T{ forward<Args>(args)... };
+    }
+
+    // Destroy a node and return its slot to the free list
+    void destroy(T* node) {
+        node->~T();
+        lock_guard<Lock> lock(poolMutex);
+        Slot* slot = reinterpret_cast<Slot*>(node);
+        slot->nextFree = freeList;
+        freeList = slot;
+        liveNodes--;
+    }
+
+    size_t live() const {
+        lock_guard<Lock> lock(poolMutex);
+        return liveNodes;
+    }
+
+    size_t reserved() const {
+        lock_guard<Lock> lock(poolMutex);
+        return slabs.size() * SLAB_SLOTS;
+    }
+};
+
+// Every Nth version of a file is stored in full (keyframe), the rest as deltas
+const int VERSION_KEYFRAME_INTERVAL = 16;
+
+// Structure to store different versions of a file in a doubly linked list.
+// Keyframes hold the full content; other versions hold a delta against the
+// previous version: keep `keepPrefix` leading and `keepSuffix` trailing
+// characters of the previous content and insert `content` between them.
+struct FileVersion
+{
+    Blob content;       // Full content (keyframe) or inserted text (delta)
+    FileVersion* prev;  // Pointer to previous version
+    FileVersion* next;  // Pointer to next version
+    int number;              // Version number, starting at 1
+    Timestamp created;       // When this version was saved
+    bool isKeyframe = true;  // True if content holds the full version
+    size_t keepPrefix = 0;   // Delta: characters kept from the start of the previous version
+    size_t keepSuffix = 0;   // Delta: characters kept from the end of the previous version
+};
+
+NodePool<FileVersion, mutex> versionPool; // Also freed by the recycle bin reaper
+
+// Build a version that turns `base` into `content`, as a delta when that is smaller
+FileVersion* makeVersion(const string& base, const string& content, FileVersion* prev)
+{
+    FileVersion* ver = versionPool.create(Blob(), prev, nullptr, prev ? prev->number + 1 : 1, currentTime());
+    if (!prev || (ver->number - 1) % VERSION_KEYFRAME_INTERVAL == 0) {
+        ver->content = content; // Periodic full snapshot bounds reconstruction cost
+        return ver;
+    }
+
+    // Common prefix and suffix shared with the previous version
+    size_t limit = min(base.length(), content.length());
+    size_t prefix = 0;
+    while (prefix < limit && base[prefix] == content[prefix]) prefix++;
+    size_t suffix = 0;
+    while (suffix < limit - prefix && base[base.length() - 1 - suffix] == content[content.length() - 1 - suffix]) suffix++;
+
+    if (prefix + suffix == 0) {
+        ver->content = content; // Nothing shared, a full copy is just as small
+        return ver;
+    }
+    ver->isKeyframe = false;
+    ver->keepPrefix = prefix;
+    ver->keepSuffix = suffix;
+    ver->content = Blob(content.substr(prefix, content.length() - prefix - suffix));
+    return ver;
+}
+
+// Apply a delta version on top of the content of its previous version
+string applyVersion(const string& base, const FileVersion* ver)
+{
+    if (ver->isKeyframe) {
+        return ver->content.str();
+    }
+    return base.substr(0, ver->keepPrefix) + ver->content.str() + base.substr(base.length() - ver->keepSuffix);
+}
+
+// Indexed version history of a file: doubly linked chain of versions plus a
+// tail pointer and an index by version number for constant-time access
+class VersionStore
+{
+public:
+    FileVersion* head;          // Oldest version
+    FileVersion* tail;          // Latest version
+    vector<FileVersion*> index; // index[k - 1] points at version k
+    Blob latestContent;         // Full content of the latest version
+
+    VersionStore()
+    {
+        head = tail = nullptr;
+    }
+
+    VersionStore(const VersionStore&) = delete;
+    VersionStore& operator=(const VersionStore&) = delete;
+
+    // Destructor to deallocate memory for versions
+    ~VersionStore() {
+        freeChain(head);
+    }
+
+    // Free a chain of versions iteratively, from ver to the end
+    static void freeChain(FileVersion* ver) {
+        while (ver) {
+            FileVersion* nextVer = ver->next;
+            versionPool.destroy(ver);
+            ver = nextVer;
+        }
+    }
+
+    int count() const {
+        return static_cast<int>(index.size());
+    }
+
+    // Get version k (1-based), or nullptr if it does not exist
+    FileVersion* at(int k) const {
+        if (k < 1 || k > count()) {
+            return nullptr;
+        }
+        return index[k - 1];
+    }
+
+    // Full content of a version
+    string materialize(FileVersion* ver) const {
+        if (ver == tail) {
+            return latestContent.str();
+        }
+        return rebuild(ver);
+    }
+
+    // Rebuild the full content of a version from the nearest keyframe before it
+    static string rebuild(FileVersion* ver) {
+        FileVersion* start = ver;
+        while (!start->isKeyframe) start = start->prev; // At most VERSION_KEYFRAME_INTERVAL steps
+        string content = start->content.str();
+        while (start != ver) {
+            start = start->next;
+            content = applyVersion(content, start);
+        }
+        return content;
+    }
+
+    // Append a new version holding the given content
+    void append(const string& content) {
+        FileVersion* ver = makeVersion(latestContent.str(), content, tail);
+        if (!tail) {
+            head = ver;
+        } else {
+            tail->next = ver;
+        }
+        tail = ver;
+        index.push_back(ver);
+        latestContent = ver->isKeyframe ? ver->content : Blob(content);
+    }
+
+    // Write the whole chain, deltas as they are, to a binary stream; content
+    // is saved as chunk references
+    void save(ostream& out) const {
+        writeBinary<int32_t>(out, count());
+        for (FileVersion* ver = head; ver; ver = ver->next) {
+            writeBinary<int32_t>(out, ver->number);
+            writeBinary<Timestamp>(out, ver->created);
+            writeBinary<uint8_t>(out, ver->isKeyframe);
+            writeBinary<uint64_t>(out, ver->keepPrefix);
+            writeBinary<uint64_t>(out, ver->keepSuffix);
+            ver->content.save(out);
+        }
+        latestContent.save(out);
+    }
+
+    // Rebuild an empty store from a chain written by save(), or by the
+    // older format with inline content and no saved latest content
+    bool load(istream& in, ContentRefs refs) {
+        int32_t versionCount;
+        if (!readBinary(in, versionCount)) {
+            return false;
+        }
+        for (int32_t i = 0; i < versionCount; i++) {
+            int32_t number;
+            Timestamp created;
+            uint8_t keyframe;
+            uint64_t prefix, suffix;
+            Blob content;
+            if (!readBinary(in, number) || !readBinary(in, created) || !readBinary(in, keyframe) ||
+                !readBinary(in, prefix) || !readBinary(in, suffix) || !Blob::load(in, refs, content)) {
+                return false;
+            }
+            FileVersion* ver = versionPool.create(move(content), tail, nullptr, number, created);
+            ver->isKeyframe = keyframe != 0;
+            ver->keepPrefix = prefix;
+            ver->keepSuffix = suffix;
+            if (!tail) {
+                head = ver;
+            } else {
+                tail->next = ver;
+            }
+            tail = ver;
+            index.push_back(ver);
+        }
+        if (refs != ContentRefs::Inline) {
+            return Blob::load(in, refs, latestContent);
+        }
+        if (tail) {
+            latestContent = tail->isKeyframe ? tail->content : Blob(rebuild(tail));
+        }
+        return true;
+    }
+
+    // Hand every content reference over to `held`, leaving the versions empty
+    void moveContentTo(vector<Blob>& held) {
+        for (FileVersion* ver = head; ver; ver = ver->next) {
+            held.push_back(move(ver->content));
+        }
+        held.push_back(move(latestContent));
+    }
+
+    // Drop every version after version k, making it the latest again
+    bool truncateTo(int k) {
+        FileVersion* keep = at(k);
+        if (!keep || keep == tail) {
+            return false;
+        }
+        latestContent = Blob(materialize(keep));
+        FileVersion* dropped = keep->next;
+        keep->next = nullptr; // Disconnect the newer versions
+        freeChain(dropped);
+        tail = keep;
+        index.resize(k);
+        return true;
+    }
+};
+
+// Symbol: 32-bit ID of an interned string
+typedef uint32_t Symbol;
+const Symbol NO_SYMBOL = 0xFFFFFFFFu; // Returned by find() for strings never interned
+
+// Global symbol table: every distinct owner, type, username and file name is
+// stored once and everything else refers to it by Symbol, so equality checks
+// are integer compares. Used from the main thread only.
+class StringInterner
+{
+public:
+    deque<string> names;                     // Symbol -> string (a deque never moves its elements)
+    unordered_map<string_view, Symbol> ids;  // String -> Symbol, viewing into names
+
+    Symbol intern(const string& name) {
+        auto it = ids.find(name);
+        if (it != ids.end()) {
+            return it->second;
+        }
+        Symbol id = static_cast<Symbol>(names.size());
+        names.push_back(name);
+        ids.emplace(names.back(), id);
+        return id;
+    }
+
+    // Symbol of a string, or NO_SYMBOL if it was never interned (never adds one)
+    Symbol find(const string& name) const {
+        auto it = ids.find(name);
+        return it == ids.end() ? NO_SYMBOL : it->second;
+    }
+
+    const string& str(Symbol id) const {
+        return names[id];
+    }
+
+    size_t size() const {
+        return names.size();
+    }
+};
+
+StringInterner symbols;
+
+// User roles, stored as one byte per account
+enum class Role : uint8_t { None, Viewer, Editor, Admin };
+
+// Parse "admin", "editor" or "viewer" (Role::None for anything else)
+Role parseRole(const string& name) {
+    if (name == "admin") return Role::Admin;
+    if (name == "editor") return Role::Editor;
+    if (name == "viewer") return Role::Viewer;
+    return Role::None;
+}
+
+string roleName(Role role) {
+    switch (role) {
+    case Role::Admin: return "admin";
+    case Role::Editor: return "editor";
+    case Role::Viewer: return "viewer";
+    default: return "";
+    }
+}
+
+// File permissions as bits, so a check is a single AND against the granted mask
+typedef uint8_t PermissionMask;
+const PermissionMask PERM_READ = 1;
+const PermissionMask PERM_WRITE = 2;
+const PermissionMask PERM_EXECUTE = 4; // Needed to share a file further
+const PermissionMask PERM_ALL = PERM_READ | PERM_WRITE | PERM_EXECUTE;
+
+// Permissions each role has on every file, indexed by Role
+const PermissionMask ROLE_PERMISSIONS[] = {
+    0,                      // None
+    PERM_READ,              // Viewer
+    PERM_READ | PERM_WRITE, // Editor
+    PERM_ALL                // Admin
+};
+
+// Parse "read", "write" or "execute" (0 for anything else)
+PermissionMask parsePermission(const string& name) {
+    if (name == "read") return PERM_READ;
+    if (name == "write") return PERM_WRITE;
+    if (name == "execute") return PERM_EXECUTE;
+    return 0;
+}
+
+struct FolderNode;
+
+// Loads a folder's children and files from the mapped image the first time
+// the folder is used (set by the file system that owns the image)
+function<void(FolderNode*)> materializeFolder;
+
+// Structure to store file information
+struct FileNode
+{
+    Symbol name;           // File name
+    Symbol type;           // File type/extension
+    Symbol owner;          // File owner/creator (username)
+    VersionStore versions {}; // Version history (indexed linked list)
+    FileNode* next = nullptr; // Pointer to next file in directory
+    FileNode* prev = nullptr; // Pointer to previous file in directory
+    FolderNode* folder = nullptr; // Folder that contains this file
+    int priority = 0;         // Priority of the file for heap management
+    int heapIndex = -1;       // Slot in the priority heap (-1 when not in the heap)
+    uint64_t id = 0;          // Identity of the file, kept across renames, moves and restores
+    Timestamp created = 0;    // Creation time
+    Timestamp modified = 0;   // Time of the last content change
+
+    // Permissions a user has on this file: everything for the owner,
+    // otherwise what their role grants plus what was shared with them
+    PermissionMask permissionsFor(Symbol username, Role role, PermissionMask shared = 0) const {
+        if (username == owner) {
+            return PERM_ALL;
+        }
+        return ROLE_PERMISSIONS[static_cast<int>(role)] | shared;
+    }
+
+    // Helper to check if a user has specific permissions on this file
+    bool canAccess(Symbol username, Role role, PermissionMask required, PermissionMask shared = 0) const {
+        return (permissionsFor(username, role, shared) & required) == required;
+    }
+};
+
+NodePool<FileNode, mutex> fileNodePool; // Also freed by the recycle bin reaper
+uint64_t lastFileId = 0; // Last identity handed out to a new file
+
+// Write a detached file with its whole version history (recycle bin segments, the namespace image)
+void saveFileNode(ostream& out, const FileNode* file)
+{
+    writeBinaryString(out, symbols.str(file->name));
+    writeBinaryString(out, symbols.str(file->type));
+    writeBinaryString(out, symbols.str(file->owner));
+    writeBinary<int32_t>(out, file->priority);
+    writeBinary<uint64_t>(out, file->id);
+    writeBinary<Timestamp>(out, file->created);
+    writeBinary<Timestamp>(out, file->modified);
+    file->versions.save(out);
+}
+
+// Read a file written by saveFileNode, or nullptr on a short or corrupt record
+FileNode* loadFileNode(istream& in, ContentRefs refs)
+{
+    string name, type, owner;
+    int32_t priority;
+    uint64_t id;
+    Timestamp created, modified;
+    if (!readBinaryString(in, name) || !readBinaryString(in, type) || !readBinaryString(in, owner) ||
+        !readBinary(in, priority) || !readBinary(in, id) || !readBinary(in, created) || !readBinary(in, modified)) {
+        return nullptr;
+    }
+    FileNode* file = fileNodePool.create(symbols.intern(name), symbols.intern(type), symbols.intern(owner));
+    file->priority = priority;
+    file->id = id;
+    file->created = created;
+    file->modified = modified;
+    if (!file->versions.load(in, refs)) {
+        fileNodePool.destroy(file);
+        return nullptr;
+    }
+    return file;
+}
+
+// Give up the content references held by a file record written by
+// saveFileNode without building the file. Nothing is interned, so the
+// recycle bin reaper can call it. False on a short or corrupt record.
+bool releaseFileRecord(istream& in, ContentRefs refs)
+{
+    string name, type, owner;
+    int32_t priority;
+    uint64_t id;
+    Timestamp created, modified;
+    if (!readBinaryString(in, name) || !readBinaryString(in, type) || !readBinaryString(in, owner) ||
+        !readBinary(in, priority) || !readBinary(in, id) || !readBinary(in, created) || !readBinary(in, modified)) {
+        return false;
+    }
+    VersionStore versions;
+    return versions.load(in, refs); // Freed with its content on return
+}
+
+// What the metadata and priority views need from a file record that refers
+// to its content by chunk, read without building the file
+struct FileRecordSummary
+{
+    string name, type, owner;
+    int32_t priority;
+    uint64_t id;
+    Timestamp created, modified;
+    uint64_t size;         // Length of the latest content
+    uint64_t contentBytes; // Length of every saved blob, as loading would count it
+};
+
+// Read a summary of a file record written by saveFileNode and skip to its
+// end. The content store is not touched. False on a short or corrupt record.
+bool readFileSummary(istream& in, FileRecordSummary& summary)
+{
+    if (!readBinaryString(in, summary.name) || !readBinaryString(in, summary.type) || !readBinaryString(in, summary.owner) ||
+        !readBinary(in, summary.priority) || !readBinary(in, summary.id) || !readBinary(in, summary.created) ||
+        !readBinary(in, summary.modified)) {
+        return false;
+    }
+    auto skipBlob = [&in](uint64_t& length) {
+        uint32_t count;
+        if (!readBinary(in, length) || !readBinary(in, count)) {
+            return false;
+        }
+        streamsize idBytes = static_cast<streamsize>(count) * sizeof(uint64_t);
+        in.ignore(idBytes);
+        return in.gcount() == idBytes;
+    };
+    int32_t versionCount;
+    if (!readBinary(in, versionCount)) {
+        return false;
+    }
+    summary.contentBytes = 0;
+    for (int32_t i = 0; i < versionCount; i++) {
+        const streamsize versionFields = sizeof(int32_t) + sizeof(Timestamp) + sizeof(uint8_t) + 2 * sizeof(uint64_t);
+        uint64_t length;
+        in.ignore(versionFields);
+        if (in.gcount() != versionFields || !skipBlob(length)) {
+            return false;
+        }
+        summary.contentBytes += length;
+    }
+    if (!skipBlob(summary.size)) {
+        return false;
+    }
+    summary.contentBytes += summary.size;
+    return true;
+}
+
+// Structure to store folder information in a tree structure
+struct FolderNode
+{
+    string name;        // Folder name
+    FolderNode* parent;  // Pointer to parent folder
+    FolderNode* child;   // Pointer to first child folder
+    FolderNode* sibling; // Pointer to next sibling folder
+    FileNode* files;     // Pointer to files in this folder
+    FolderNode* prevSibling = nullptr; // Pointer to previous sibling folder
+    FolderNode* lastChild = nullptr;   // Tail of the child folder list
+    FileNode* lastFile = nullptr;      // Tail of the file list
+    unordered_map<string, FolderNode*> childIndex {}; // Child folders by name
+    unordered_map<Symbol, FileNode*> fileIndex {};    // Files by name
+    uint64_t id = 0;                                  // Identity of the folder, kept across renames and moves
+    bool loaded = true;      // False while the children and files are still only in the mapped image
+    uint64_t imageIndex = 0; // Record of this folder in the mapped image
+
+    // Bring in the children and files from the mapped image on first use
+    void ensureLoaded() {
+        if (!loaded) {
+            materializeFolder(this);
+        }
+    }
+
+    // Find a child folder by name
+    FolderNode* findChild(const string& childName) {
+        ensureLoaded();
+        auto it = childIndex.find(childName);
+        return it == childIndex.end() ? nullptr : it->second;
+    }
+
+    // Find a file in this folder by name. Load the folder first: the names
+    // of files still only in the image are not interned yet.
+    FileNode* findFile(const string& fileName) {
+        ensureLoaded();
+        return findFile(symbols.find(fileName));
+    }
+
+    FileNode* findFile(Symbol fileName) {
+        ensureLoaded();
+        auto it = fileIndex.find(fileName);
+        return it == fileIndex.end() ? nullptr : it->second;
+    }
+
+    // Append a folder to the child list
+    void addChild(FolderNode* folder) {
+        ensureLoaded();
+        folder->parent = this;
+        folder->sibling = nullptr;
+        folder->prevSibling = lastChild;
+        if (lastChild) {
+            lastChild->sibling = folder;
+        } else {
+            child = folder;
+        }
+        lastChild = folder;
+        childIndex[folder->name] = folder;
+    }
+
+    // Unlink a child folder (the folder itself is not freed)
+    void removeChild(FolderNode* folder) {
+        if (folder->prevSibling) {
+            folder->prevSibling->sibling = folder->sibling;
+        } else {
+            child = folder->sibling;
+        }
+        if (folder->sibling) {
+            folder->sibling->prevSibling = folder->prevSibling;
+        } else {
+            lastChild = folder->prevSibling;
+        }
+        folder->sibling = folder->prevSibling = nullptr;
+        childIndex.erase(folder->name);
+    }
+
+    // Append a file to the file list
+    void addFile(FileNode* file) {
+        ensureLoaded();
+        file->folder = this;
+        file->next = nullptr;
+        file->prev = lastFile;
+        if (lastFile) {
+            lastFile->next = file;
+        } else {
+            files = file;
+        }
+        lastFile = file;
+        fileIndex[file->name] = file;
+    }
+
+    // Unlink a file (the file itself is not freed)
+    void removeFile(FileNode* file) {
+        if (file->prev) {
+            file->prev->next = file->next;
+        } else {
+            files = file->next;
+        }
+        if (file->next) {
+            file->next->prev = file->prev;
+        } else {
+            lastFile = file->prev;
+        }
+        file->next = file->prev = nullptr;
+        file->folder = nullptr;
+        fileIndex.erase(file->name);
+    }
+};
+
+NodePool<FolderNode> folderPool;
+uint64_t lastFolderId = 0; // Last identity handed out to a new folder
+
+// Free a folder with all of its subfolders and files in one iterative pass.
+// The folder must already be unlinked from its parent's child list.
+void destroyFolderTree(FolderNode* folder)
+{
+    vector<FolderNode*> pending{ folder };
+    while (!pending.empty()) {
+        FolderNode* curr = pending.back();
+        pending.pop_back();
+        for (FolderNode* sub = curr->child; sub; sub = sub->sibling) {
+            pending.push_back(sub);
+        }
+        FileNode* currentFile = curr->files;
+        while (currentFile) {
+            FileNode* nextFile = currentFile->next;
+            fileNodePool.destroy(currentFile); // Frees its versions as well
+            currentFile = nextFile;
+        }
+        folderPool.destroy(curr);
+    }
+}
+
+// Structure for file metadata used in hash table
+struct fileData
+{
+    string name;  // Full path of the file, e.g. /root/docs/report (table key)
+    Symbol type;
+    Symbol owner;
+    int size;
+    Timestamp created;  // Creation time (for time-range queries)
+    Timestamp modified; // Last modification time
+    size_t row = 0;   // Row of this record in the columnar store
+};
+
+NodePool<fileData> metadataPool;
+
+// DeletedFile::segment of an entry whose file is still only a record in the
+// namespace image; it is read from there when the entry is restored
+const int IMAGE_RECORD = -2;
+
+// Structure for deleted files using stack implementation
+struct DeletedFile
+{
+    // Links to the neighbouring entries that share a key in one of the recycle bin's indexes
+    struct Chain {
+        DeletedFile* older = nullptr;
+        DeletedFile* newer = nullptr;
+    };
+
+    Symbol name;
+    string originalPath;    // Full path the file was deleted from
+    FileNode* file;         // The detached file, with its whole version history (nullptr while spilled)
+    Timestamp deletionTime; // Timestamp for auto-deletion
+    DeletedFile* next;  // Pointer to next deleted file in stack (older)
+    DeletedFile* prev = nullptr; // Pointer to previous deleted file in stack (newer)
+    size_t heapIndex = 0;        // Position in the recycle bin's expiry heap
+    int versionCount = 0;        // Versions kept, also known while spilled
+    size_t memoryBytes = 0;      // Approximate memory held while in RAM
+    int segment = -1;            // Spill segment holding the file, IMAGE_RECORD, or -1 if in RAM
+    uint64_t segmentOffset = 0;  // Start of the file's record in that segment (or in the image)
+    uint64_t recordBytes = 0;    // Length of the record in the image
+    vector<Blob> heldContent {}; // Keeps the chunks a spilled record refers to
+    Chain samePath = {};         // Other entries deleted from the same path
+    Chain sameName = {};         // Other entries with the same file name
+};
+
+NodePool<DeletedFile, mutex> deletedFilePool; // Also freed by the recycle bin reaper
+
+// Structure for recent files using queue implementation
+struct RecentFile
+{
+    uint64_t fileId;   // Identity of the file
+    string path;       // Full path of the file when it was last accessed
+    RecentFile* prev;  // Pointer to previous recent file in queue (less recent)
+    RecentFile* next;  // Pointer to next recent file in queue (more recent)
+};
+
+NodePool<RecentFile> recentFilePool;
+
+// SHA-256 of a byte string, as 64 hex digits
+string sha256Hex(const string& message)
+{
+    static const uint32_t k[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+    uint32_t h[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    auto rotr = [](uint32_t x, int n) { return (x >> n) | (x << (32 - n)); };
+
+    // Pad to a whole number of 64-byte blocks, ending with the length in bits
+    string data = message;
+    uint64_t bits = static_cast<uint64_t>(message.size()) * 8;
+    data += static_cast<char>(0x80);
+    while (data.size() % 64 != 56) {
+        data += '\0';
+    }
+    for (int i = 7; i >= 0; i--) {
+        data += static_cast<char>((bits >> (i * 8)) & 0xff);
+    }
+
+    for (size_t block = 0; block < data.size(); block += 64) {
+        uint32_t w[64];
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data.data() + block);
+        for (int i = 0; i < 16; i++) {
+            w[i] = (uint32_t(bytes[i * 4]) << 24) | (uint32_t(bytes[i * 4 + 1]) << 16) | (uint32_t(bytes[i * 4 + 2]) << 8) | bytes[i * 4 + 3];
+        }
+        for (int i = 16; i < 64; i++) {
+            uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], hh = h[7];
+        for (int i = 0; i < 64; i++) {
+            uint32_t t1 = hh + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + k[i] + w[i];
+            uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            hh = g; g = f; f = e; e = d + t1;
+            d = c; c = b; b = a; a = t1 + t2;
+        }
+        h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e; h[5] += f; h[6] += g; h[7] += hh;
+    }
+
+    string hex;
+    char digits[9];
+    for (uint32_t word : h) {
+        snprintf(digits, sizeof(digits), "%08x", word);
+        hex += digits;
+    }
+    return hex;
+}
+
+// Check sha256Hex() against the known answers of FIPS 180-2 (one block,
+// padding that spills into a second block, a long message) before it is
+// trusted with credentials; false on any mismatch
+bool sha256SelfTest()
+{
+    const pair<string, const char*> knownAnswers[] = {
+        { "", "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855" },
+        { "abc", "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad" },
+        { "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1" },
+        { "abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmnhijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu",
+          "cf5b16a778af8380036ce59e7b0492370b249b11e8f07a51afac45037afee9d1" },
+        { string(1000000, 'a'), "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0" },
+    };
+    for (const auto& known : knownAnswers) {
+        if (sha256Hex(known.first) != known.second) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Rounds of SHA-256 per credential hash, so guessing a stolen hash is slow
+const int CREDENTIAL_HASH_ROUNDS = 4096;
+
+// Salted, stretched hash of a password or security answer. Only hashes are
+// kept, in memory, in the namespace image and in the write-ahead log.
+string hashCredential(const string& salt, const string& secret)
+{
+    string digest = sha256Hex(salt + secret);
+    for (int round = 1; round < CREDENTIAL_HASH_ROUNDS; round++) {
+        digest = sha256Hex(salt + digest);
+    }
+    return digest;
+}
+
+// Whether a secret matches a stored hash (compares every digit, so the time taken does not leak the match length)
+bool credentialMatches(const string& salt, const string& secret, const string& hash)
+{
+    string candidate = hashCredential(salt, secret);
+    if (candidate.size() != hash.size()) {
+        return false;
+    }
+    unsigned char difference = 0;
+    for (size_t i = 0; i < hash.size(); i++) {
+        difference |= candidate[i] ^ hash[i];
+    }
+    return difference == 0;
+}
+
+// A fresh random 128-bit salt, as hex digits
+string newSalt()
+{
+    random_device source;
+    string salt;
+    char digits[9];
+    for (int i = 0; i < 4; i++) {
+        snprintf(digits, sizeof(digits), "%08x", static_cast<uint32_t>(source()));
+        salt += digits;
+    }
+    return salt;
+}
+
+// A user account, one node of the linked list kept by UserAuth
+struct UserNode {
+    uint32_t id;     // Dense user ID, assigned at signup
+    Symbol username;
+    string salt;           // Random salt shared by both credential hashes
+    string passwordHash;   // hashCredential(salt, password)
+    Role role;       // Admin, Editor, Viewer
+    string answerHash;     // hashCredential(salt, security answer), for password recovery
+    Timestamp lastLogout;  // Timestamp of last logout (0 if never)
+    UserNode* next;       // Pointer to next user
+};
+
+NodePool<UserNode> userPool;
+
+// Graph IDs with this bit set name a group; users keep the IDs from UserAuth
+const uint32_t GROUP_ID_FLAG = 0x80000000u;
+// Shared object keys with this bit set name a folder, the rest a file
+const uint64_t FOLDER_KEY_FLAG = 1ULL << 63;
+
+// A file or folder shared by a user with a user or group; the edge appears
+// in the owner's outbound and the receiver's inbound adjacency
+struct ShareEdge {
+    uint32_t ownerId;    // User who shared the file or folder
+    uint32_t receiverId; // User or group it was shared with
+    uint64_t objectKey;  // File identity, or folder identity | FOLDER_KEY_FLAG
+    string path;         // Full path of the file or folder when it was shared
+    PermissionMask permissions;
+};
+
+NodePool<ShareEdge> shareEdgePool;
+
+// Structure for graph-based user connections (adjacency lists keyed by shared
+// object and graph ID). A node is a user or a group; groups have members,
+// which may be users or other groups.
+struct UserGraphNode {
+    uint32_t id;
+    Symbol username; // User name, or "@name" for a group
+    unordered_map<uint64_t, unordered_map<uint32_t, ShareEdge*>> outbound {}; // Object -> receiver -> edge
+    unordered_map<uint64_t, unordered_map<uint32_t, ShareEdge*>> inbound {};  // Object -> owner -> edge
+    size_t outboundCount = 0;
+    size_t inboundCount = 0;
+    unordered_set<uint32_t> members {};  // Group: users and groups in it
+    unordered_set<uint32_t> memberOf {}; // Groups this user or group is directly in
+    uint32_t ownerId = 0;                // Group: user who created it
+    UserGraphNode* next = nullptr;
+};
+
+NodePool<UserGraphNode> userGraphPool;
+
+// Heap structure for managing file priorities (Max-Heap).
+// Addressable: every FileNode remembers its slot in heapIndex, so a file's
+// priority can be changed or the file removed in O(log n) without a search.
+// The array grows as needed.
+class FilePriorityHeap {
+private:
+    vector<FileNode*> heapArray;
+
+    // Swap two slots and keep their files' handles in step
+    void swapSlots(size_t a, size_t b) {
+        swap(heapArray[a], heapArray[b]);
+        heapArray[a]->heapIndex = static_cast<int>(a);
+        heapArray[b]->heapIndex = static_cast<int>(b);
+    }
+
+    void heapifyUp(size_t index) {
+        while (index > 0 && heapArray[index]->priority > heapArray[(index - 1) / 2]->priority) {
+            swapSlots(index, (index - 1) / 2);
+            index = (index - 1) / 2;
+        }
+    }
+
+    void heapifyDown(size_t index) {
+        size_t size = heapArray.size();
+        while (true) {
+            size_t leftChild = 2 * index + 1;
+            size_t rightChild = 2 * index + 2;
+            size_t largestChild = index;
+
+            if (leftChild < size && heapArray[leftChild]->priority > heapArray[largestChild]->priority) {
+                largestChild = leftChild;
+            }
+
+            if (rightChild < size && heapArray[rightChild]->priority > heapArray[largestChild]->priority) {
+                largestChild = rightChild;
+            }
+
+            if (largestChild == index) {
+                break;
+            }
+
+            swapSlots(index, largestChild);
+            index = largestChild;
+        }
+    }
+
+    // Restore the heap order around a slot whose priority changed either way
+    void sift(size_t index) {
+        heapifyUp(index);
+        heapifyDown(index);
+    }
+
+public:
+    // Heap itself holds pointers, actual FileNode objects are owned by FolderNode
+
+    int size() const { return static_cast<int>(heapArray.size()); }
+
+    // Whether a file is currently tracked by the heap
+    bool contains(const FileNode* file) const {
+        return file->heapIndex >= 0 && static_cast<size_t>(file->heapIndex) < heapArray.size() && heapArray[file->heapIndex] == file;
+    }
+
+    void insert(FileNode* file) {
+        if (contains(file)) {
+            return;
+        }
+        file->heapIndex = static_cast<int>(heapArray.size());
+        heapArray.push_back(file);
+        heapifyUp(heapArray.size() - 1);
+    }
+
+    // Remove a file by its handle (no-op if the file is not in the heap)
+    void remove(FileNode* file) {
+        if (!contains(file)) {
+            return;
+        }
+        size_t index = static_cast<size_t>(file->heapIndex);
+        size_t last = heapArray.size() - 1;
+        if (index != last) {
+            swapSlots(index, last);
+        }
+        heapArray.pop_back();
+        file->heapIndex = -1;
+        if (index < heapArray.size()) {
+            sift(index);
+        }
+    }
+
+    // Change a file's priority and move it to its new place in the heap
+    void updatePriority(FileNode* file, int priority) {
+        file->priority = priority;
+        if (contains(file)) {
+            sift(static_cast<size_t>(file->heapIndex));
+        }
+    }
+
+    FileNode* extractMax() {
+        if (heapArray.empty()) {
+            cout << RED << "Heap is empty." << RESET << endl;
+            return nullptr;
+        }
+        FileNode* max = heapArray[0];
+        remove(max);
+        return max;
+    }
+
+    // The k highest-priority files that pass a filter, highest first, without
+    // modifying the heap. A side heap holds the frontier of slots whose parents
+    // have been visited. An unfiltered query looks at O(k) slots, so it costs
+    // O(k log k). A filtered query also walks past the files it rejects.
+    template <typename Accept>
+    vector<FileNode*> topK(size_t k, Accept accept) const {
+        vector<FileNode*> result;
+        if (k == 0 || heapArray.empty()) {
+            return result;
+        }
+        auto lowerPriority = [this](size_t a, size_t b) { return heapArray[a]->priority < heapArray[b]->priority; };
+        vector<size_t> frontier = { 0 };
+        while (!frontier.empty() && result.size() < k) {
+            pop_heap(frontier.begin(), frontier.end(), lowerPriority);
+            size_t index = frontier.back();
+            frontier.pop_back();
+            if (accept(heapArray[index])) {
+                result.push_back(heapArray[index]);
+            }
+            for (size_t child = 2 * index + 1; child <= 2 * index + 2 && child < heapArray.size(); child++) {
+                frontier.push_back(child);
+                push_heap(frontier.begin(), frontier.end(), lowerPriority);
+            }
+        }
+        return result;
+    }
+
+    vector<FileNode*> topK(size_t k) const {
+        return topK(k, [](const FileNode*) { return true; });
+    }
+
+    // List the files by priority, merged with `unloaded` (priority, name) for
+    // files that are not in the heap because they are still only in the image
+    void display(vector<pair<int, string>> unloaded = {}) {
+        if (heapArray.empty() && unloaded.empty()) {
+            cout << RED << "Heap is empty." << RESET << endl;
+            return;
+        }
+        stable_sort(unloaded.begin(), unloaded.end(), [](const pair<int, string>& a, const pair<int, string>& b) { return a.first > b.first; });
+        cout << CYAN << "Files in Heap by Priority (Max Priority First):" << RESET << endl;
+        size_t next = 0;
+        for (FileNode* file : topK(heapArray.size())) {
+            for (; next < unloaded.size() && unloaded[next].first > file->priority; next++) {
+                cout << YELLOW << unloaded[next].second << " (Priority: " << unloaded[next].first << ")" << RESET << endl;
+            }
+            cout << YELLOW << symbols.str(file->name) << " (Priority: " << file->priority << ")" << RESET << endl;
+        }
+        for (; next < unloaded.size(); next++) {
+            cout << YELLOW << unloaded[next].second << " (Priority: " << unloaded[next].first << ")" << RESET << endl;
+        }
+    }
+};
+
+// Dense codes for the values of one low-cardinality column. Symbols are
+// shared with file names, so they are too sparse to index a per-group array.
+class ColumnDictionary
+{
+public:
+    vector<Symbol> values; // Code -> symbol
+    unordered_map<Symbol, uint32_t> codes;
+
+    uint32_t encode(Symbol value) {
+        auto it = codes.find(value);
+        if (it != codes.end()) {
+            return it->second;
+        }
+        uint32_t code = values.size();
+        codes.emplace(value, code);
+        values.push_back(value);
+        return code;
+    }
+
+    size_t size() const {
+        return values.size();
+    }
+};
+
+// Columnar (structure-of-arrays) copy of the metadata for aggregate scans.
+// Each file is one row; every field lives in its own contiguous array so the
+// aggregate kernels below stream through memory instead of chasing records.
+// Owner and type are stored as dense per-column codes.
+class MetadataColumns
+{
+public:
+    ColumnDictionary owners;
+    ColumnDictionary types;
+    vector<uint32_t> ownerId;
+    vector<uint32_t> typeId;
+    vector<long long> size;
+    vector<long long> created;
+    vector<long long> modified;
+    vector<fileData*> record; // Row -> record, to report names
+
+    size_t rows() const {
+        return record.size();
+    }
+
+    void add(fileData* data) {
+        data->row = record.size();
+        ownerId.push_back(owners.encode(data->owner));
+        typeId.push_back(types.encode(data->type));
+        size.push_back(data->size);
+        created.push_back(data->created);
+        modified.push_back(data->modified);
+        record.push_back(data);
+    }
+
+    // Refresh a row after its record changed
+    void update(fileData* data) {
+        size_t row = data->row;
+        ownerId[row] = owners.encode(data->owner);
+        typeId[row] = types.encode(data->type);
+        size[row] = data->size;
+        created[row] = data->created;
+        modified[row] = data->modified;
+    }
+
+    // Remove a row by moving the last row into its place
+    void remove(fileData* data) {
+        size_t row = data->row;
+        size_t last = record.size() - 1;
+        if (row != last) {
+            ownerId[row] = ownerId[last];
+            typeId[row] = typeId[last];
+            size[row] = size[last];
+            created[row] = created[last];
+            modified[row] = modified[last];
+            record[row] = record[last];
+            record[row]->row = row;
+        }
+        ownerId.pop_back();
+        typeId.pop_back();
+        size.pop_back();
+        created.pop_back();
+        modified.pop_back();
+        record.pop_back();
+    }
+
+    // Total bytes over all files (vectorizable reduction)
+    long long totalBytes() const {
+        const long long* sizes = size.data();
+        long long total = 0;
+        for (size_t i = 0, n = size.size(); i < n; i++) {
+            total += sizes[i];
+        }
+        return total;
+    }
+
+    // Bytes in files modified at or after a time (branch-free, vectorizable)
+    long long bytesModifiedSince(long long since) const {
+        const long long* sizes = size.data();
+        const long long* times = modified.data();
+        long long total = 0;
+        for (size_t i = 0, n = size.size(); i < n; i++) {
+            total += sizes[i] * (times[i] >= since);
+        }
+        return total;
+    }
+
+    // Bytes per owner, indexed by owner code (owners.values maps back)
+    vector<long long> bytesPerOwner() const {
+        vector<long long> totals(owners.size(), 0);
+        const uint32_t* ids = ownerId.data();
+        const long long* sizes = size.data();
+        for (size_t i = 0, n = size.size(); i < n; i++) {
+            totals[ids[i]] += sizes[i];
+        }
+        return totals;
+    }
+
+    // File count per type, indexed by type code (types.values maps back)
+    vector<long long> filesPerType() const {
+        vector<long long> counts(types.size(), 0);
+        const uint32_t* ids = typeId.data();
+        for (size_t i = 0, n = typeId.size(); i < n; i++) {
+            counts[ids[i]]++;
+        }
+        return counts;
+    }
+
+    // Rows of the n largest files, largest first
+    vector<size_t> largestRows(size_t n) const {
+        vector<size_t> order(size.size());
+        for (size_t i = 0; i < order.size(); i++) {
+            order[i] = i;
+        }
+        n = min(n, order.size());
+        auto bigger = [this](size_t a, size_t b) { return size[a] > size[b]; };
+        partial_sort(order.begin(), order.begin() + n, order.end(), bigger);
+        order.resize(n);
+        return order;
+    }
+};
+
+// Hash Table class for storing file metadata, keyed by full file path.
+// Open addressing with Robin Hood probing: an entry that is further from its
+// home slot takes the place of one that is closer, which keeps probe lengths
+// short and even. The table doubles when it gets MAX_LOAD_FACTOR full.
+class HashTable {
+private:
+    struct Slot {
+        fileData* data;  // nullptr when the slot is empty
+        uint64_t hash;   // Cached hash of data->name
+        int distance;    // Probe distance from the home slot
+    };
+    const double MAX_LOAD_FACTOR = 0.875;
+
+    Slot* slots;
+    size_t capacity; // Always a power of two
+    size_t count;
+
+    // Secondary indexes over the records in the table
+    unordered_map<Symbol, unordered_set<fileData*>> byOwner;
+    unordered_map<Symbol, unordered_set<fileData*>> byType;
+    set<pair<long long, fileData*>> bySize;
+    set<pair<long long, fileData*>> byCreated;
+    set<pair<long long, fileData*>> byModified;
+
+    void indexAdd(fileData* data) {
+        byOwner[data->owner].insert(data);
+        byType[data->type].insert(data);
+        bySize.emplace(data->size, data);
+        byCreated.emplace(data->created, data);
+        byModified.emplace(data->modified, data);
+    }
+
+    void indexRemove(fileData* data) {
+        auto owners = byOwner.find(data->owner);
+        owners->second.erase(data);
+        if (owners->second.empty()) byOwner.erase(owners);
+        auto types = byType.find(data->type);
+        types->second.erase(data);
+        if (types->second.empty()) byType.erase(types);
+        bySize.erase({ data->size, data });
+        byCreated.erase({ data->created, data });
+        byModified.erase({ data->modified, data });
+    }
+
+    static uint64_t hashKey(const string& key) {
+        return hashBytes(key.data(), key.length());
+    }
+
+    // Robin Hood insertion of an entry known not to be in the table
+    void place(fileData* data, uint64_t hash) {
+        size_t mask = capacity - 1;
+        Slot incoming{ data, hash, 0 };
+        size_t pos = hash & mask;
+        while (slots[pos].data) {
+            if (slots[pos].distance < incoming.distance) {
+                swap(slots[pos], incoming); // Take from the rich, keep probing with the displaced entry
+            }
+            pos = (pos + 1) & mask;
+            incoming.distance++;
+        }
+        slots[pos] = incoming;
+    }
+
+    // Slot index holding the key, or capacity if absent
+    size_t findSlot(const string& key) const {
+        uint64_t hash = hashKey(key);
+        size_t mask = capacity - 1;
+        size_t pos = hash & mask;
+        for (int distance = 0; slots[pos].data && slots[pos].distance >= distance; distance++) {
+            if (slots[pos].hash == hash && slots[pos].data->name == key) {
+                return pos;
+            }
+            pos = (pos + 1) & mask;
+        }
+        return capacity;
+    }
+
+    // Remove the entry at a slot, shifting the following cluster back by one
+    void eraseSlot(size_t pos) {
+        size_t mask = capacity - 1;
+        size_t nextPos = (pos + 1) & mask;
+        while (slots[nextPos].data && slots[nextPos].distance > 0) {
+            slots[pos] = slots[nextPos];
+            slots[pos].distance--;
+            pos = nextPos;
+            nextPos = (nextPos + 1) & mask;
+        }
+        slots[pos] = Slot{ nullptr, 0, 0 };
+        count--;
+    }
+
+    void grow() {
+        Slot* oldSlots = slots;
+        size_t oldCapacity = capacity;
+        capacity *= 2;
+        slots = new Slot[capacity]();
+        for (size_t i = 0; i < oldCapacity; i++) {
+            if (oldSlots[i].data) {
+                place(oldSlots[i].data, oldSlots[i].hash);
+            }
+        }
+        delete[] oldSlots;
+    }
+
+public:
+    MetadataColumns columns; // Columnar copy of the records for aggregate scans
+
+    // Constructor to initialize hash table
+    HashTable(size_t initialCapacity = 128)
+    {
+        capacity = initialCapacity;
+        count = 0;
+        slots = new Slot[capacity]();
+    }
+
+    HashTable(const HashTable&) = delete;
+    HashTable& operator=(const HashTable&) = delete;
+
+    // Destructor to free the metadata records
+    ~HashTable() {
+        for (size_t i = 0; i < capacity; i++) {
+            if (slots[i].data) {
+                metadataPool.destroy(slots[i].data);
+            }
+        }
+        delete[] slots;
+    }
+
+    // Insert new file metadata into hash table (modified defaults to created)
+    void insert(string key, Symbol type, int size, Symbol owner, Timestamp created, Timestamp modified = 0)
+    {
+        if (modified == 0) {
+            modified = created;
+        }
+        // Check for duplication before inserting
+        fileData* curr = search(key);
+        if (curr) {
+            indexRemove(curr);
+            curr->type = type;
+            curr->owner = owner;
+            curr->size = size;
+            curr->modified = modified;
+            indexAdd(curr);
+            columns.update(curr);
+            return;
+        }
+
+        if (count + 1 > capacity * MAX_LOAD_FACTOR) {
+            grow();
+        }
+        fileData* data = metadataPool.create(key, type, owner, size, created, modified);
+        place(data, hashKey(key));
+        indexAdd(data);
+        columns.add(data);
+        count++;
+    }
+
+    // Search for file metadata by full path
+    fileData* search(string key)
+    {
+        size_t pos = findSlot(key);
+        return pos == capacity ? nullptr : slots[pos].data;
+    }
+
+    // Record a content change: new size and modification time
+    void touch(const string& key, int size, Timestamp modified) {
+        fileData* data = search(key);
+        if (!data) {
+            return;
+        }
+        indexRemove(data);
+        data->size = size;
+        data->modified = modified;
+        indexAdd(data);
+        columns.update(data);
+    }
+
+    // Move metadata to a new key (after a folder rename or move)
+    void rekey(const string& oldKey, const string& newKey) {
+        size_t pos = findSlot(oldKey);
+        if (pos == capacity) {
+            return;
+        }
+        fileData* data = slots[pos].data;
+        eraseSlot(pos);
+        data->name = newKey;
+        place(data, hashKey(newKey));
+        count++;
+    }
+
+    // Remove file metadata from hash table; false if there is none for the key
+    bool remove(string key) {
+        size_t pos = findSlot(key);
+        if (pos == capacity) {
+            return false;
+        }
+        indexRemove(slots[pos].data);
+        columns.remove(slots[pos].data);
+        metadataPool.destroy(slots[pos].data);
+        eraseSlot(pos);
+        return true;
+    }
+
+    // Run a query such as "owner=alice AND type=.pdf AND size>1MB".
+    // Fields: owner, type (= and !=); size, created, modified (=, !=, <, <=, >, >=); == is the same as =.
+    // Sizes accept B/KB/MB/GB suffixes, times are epoch seconds or YYYY-MM-DD.
+    // The most selective indexed predicate picks the candidates, the rest filter them.
+    // Records in `unindexed` (files not in the table) are checked one by one.
+    bool query(const string& expression, vector<fileData*>& results, const vector<fileData*>& unindexed = {}) {
+        struct Predicate {
+            string field;
+            string op;
+            string text;     // Value for owner/type
+            long long value; // Value for size/time fields
+            Symbol symbol;   // Interned owner/type value (NO_SYMBOL if no file has it)
+        };
+        vector<Predicate> predicates;
+
+        // Split on AND (any case) and parse each "field op value" term
+        istringstream words(expression);
+        string word, term;
+        vector<string> terms;
+        while (words >> word) {
+            string upper = word;
+            for (char& c : upper) c = static_cast<char>(toupper(static_cast<unsigned char>(c)));
+            if (upper == "AND") {
+                terms.push_back(term);
+                term.clear();
+            } else {
+                term += word;
+            }
+        }
+        terms.push_back(term);
+
+        for (const string& t : terms) {
+            size_t opPos = t.find_first_of("=!<>");
+            if (t.empty() || opPos == string::npos || opPos == 0) {
+                cout << RED << "Invalid query term '" << t << "'." << RESET << endl;
+                return false;
+            }
+            size_t opEnd = opPos + 1;
+            if (opEnd < t.length() && t[opEnd] == '=') opEnd++;
+            Predicate pred{ t.substr(0, opPos), t.substr(opPos, opEnd - opPos), t.substr(opEnd), 0, NO_SYMBOL };
+            if (pred.op == "==") {
+                pred.op = "="; // Accepted as a synonym
+            }
+            if (pred.op == "!") {
+                cout << RED << "Invalid operator in '" << t << "'." << RESET << endl;
+                return false;
+            }
+            if (pred.field == "owner" || pred.field == "type") {
+                if (pred.op != "=" && pred.op != "!=") {
+                    cout << RED << "Only = and != are supported for " << pred.field << "." << RESET << endl;
+                    return false;
+                }
+                pred.symbol = symbols.find(pred.text);
+            } else if (pred.field == "size") {
+                if (!parseSize(pred.text, pred.value)) {
+                    cout << RED << "Invalid size '" << pred.text << "'." << RESET << endl;
+                    return false;
+                }
+            } else if (pred.field == "created" || pred.field == "modified") {
+                if (!parseTime(pred.text, pred.value)) {
+                    cout << RED << "Invalid time '" << pred.text << "'." << RESET << endl;
+                    return false;
+                }
+            } else {
+                cout << RED << "Unknown field '" << pred.field << "'." << RESET << endl;
+                return false;
+            }
+            predicates.push_back(pred);
+        }
+
+        // Candidate set from the smallest equality index, or else the first range predicate
+        const unordered_set<fileData*>* bestSet = nullptr;
+        const Predicate* rangePred = nullptr;
+        bool emptyResult = false;
+        for (const Predicate& pred : predicates) {
+            if (pred.op == "=" && (pred.field == "owner" || pred.field == "type")) {
+                auto& index = pred.field == "owner" ? byOwner : byType;
+                auto it = index.find(pred.symbol);
+                if (it == index.end()) {
+                    emptyResult = true;
+                } else if (!bestSet || it->second.size() < bestSet->size()) {
+                    bestSet = &it->second;
+                }
+            } else if (!rangePred && pred.op != "!=" && pred.field != "owner" && pred.field != "type") {
+                rangePred = &pred;
+            }
+        }
+
+        auto matches = [&](fileData* data) {
+            for (const Predicate& pred : predicates) {
+                bool ok;
+                if (pred.field == "owner" || pred.field == "type") {
+                    ok = ((pred.field == "owner" ? data->owner : data->type) == pred.symbol) == (pred.op == "=");
+                } else {
+                    long long v = pred.field == "size" ? data->size : (pred.field == "created" ? data->created : data->modified);
+                    ok = compareValues(v, pred.op, pred.value);
+                }
+                if (!ok) return false;
+            }
+            return true;
+        };
+
+        results.clear();
+        if (emptyResult) {
+            // No indexed file can match
+        } else if (bestSet) {
+            for (fileData* data : *bestSet) {
+                if (matches(data)) results.push_back(data);
+            }
+        } else if (rangePred) {
+            auto& index = rangePred->field == "size" ? bySize : (rangePred->field == "created" ? byCreated : byModified);
+            long long v = rangePred->value;
+            auto first = index.begin();
+            auto last = index.end();
+            if (rangePred->op == "=" || rangePred->op == ">=") first = index.lower_bound({ v, nullptr });
+            if (rangePred->op == ">") first = index.upper_bound({ v, reinterpret_cast<fileData*>(UINTPTR_MAX) });
+            if (rangePred->op == "=" || rangePred->op == "<=") last = index.upper_bound({ v, reinterpret_cast<fileData*>(UINTPTR_MAX) });
+            if (rangePred->op == "<") last = index.lower_bound({ v, nullptr });
+            for (auto it = first; it != last; ++it) {
+                if (matches(it->second)) results.push_back(it->second);
+            }
+        } else {
+            for (size_t i = 0; i < capacity; i++) { // Only != predicates, scan everything
+                if (slots[i].data && matches(slots[i].data)) results.push_back(slots[i].data);
+            }
+        }
+        for (fileData* data : unindexed) {
+            if (matches(data)) results.push_back(data);
+        }
+        return true;
+    }
+
+    static bool compareValues(long long v, const string& op, long long target) {
+        if (op == "=") return v == target;
+        if (op == "!=") return v != target;
+        if (op == "<") return v < target;
+        if (op == "<=") return v <= target;
+        if (op == ">") return v > target;
+        if (op == ">=") return v >= target;
+        return false;
+    }
+
+    // Parse sizes like 512, 10KB, 1MB, 2GB
+    static bool parseSize(const string& text, long long& bytes) {
+        size_t digits = 0;
+        while (digits < text.length() && isdigit(static_cast<unsigned char>(text[digits]))) digits++;
+        if (digits == 0) return false;
+        string unit = text.substr(digits);
+        for (char& c : unit) c = static_cast<char>(toupper(static_cast<unsigned char>(c)));
+        long long multiplier;
+        if (unit == "" || unit == "B") multiplier = 1;
+        else if (unit == "KB") multiplier = 1024LL;
+        else if (unit == "MB") multiplier = 1024LL * 1024;
+        else if (unit == "GB") multiplier = 1024LL * 1024 * 1024;
+        else return false;
+        long long count;
+        auto parsed = from_chars(text.data(), text.data() + digits, count);
+        if (parsed.ec != errc() || count > numeric_limits<long long>::max() / multiplier) {
+            return false; // Too large to be a size
+        }
+        bytes = count * multiplier;
+        return true;
+    }
+
+    // Parse epoch seconds or a YYYY-MM-DD date (local midnight)
+    static bool parseTime(const string& text, long long& seconds) {
+        int year, month, day;
+        char extra;
+        if (sscanf(text.c_str(), "%d-%d-%d%c", &year, &month, &day, &extra) == 3) {
+            tm date = {};
+            date.tm_year = year - 1900;
+            date.tm_mon = month - 1;
+            date.tm_mday = day;
+            date.tm_isdst = -1;
+            time_t parsed = mktime(&date);
+            if (parsed == static_cast<time_t>(-1) || date.tm_year != year - 1900 || date.tm_mon != month - 1 || date.tm_mday != day) {
+                return false; // mktime() would turn 2024-02-31 into March 2nd
+            }
+            seconds = static_cast<long long>(parsed);
+            return true;
+        }
+        if (!text.empty() && text.find_first_not_of("0123456789") == string::npos) {
+            return from_chars(text.data(), text.data() + text.length(), seconds).ec == errc(); // Fails when out of range
+        }
+        return false;
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+    // Display load factor and probe length statistics
+    void displayStats() const {
+        long long totalDistance = 0;
+        int maxDistance = 0;
+        for (size_t i = 0; i < capacity; i++) {
+            if (slots[i].data) {
+                totalDistance += slots[i].distance;
+                maxDistance = max(maxDistance, slots[i].distance);
+            }
+        }
+        cout << CYAN << "Metadata Table Statistics:" << RESET << endl;
+        cout << YELLOW << "Entries: " << count << " / " << capacity << " slots"
+             << "\nLoad factor: " << static_cast<double>(count) / capacity
+             << "\nAverage probe length: " << (count ? static_cast<double>(totalDistance) / count : 0.0)
+             << "\nMax probe length: " << maxDistance << RESET << endl;
+    }
+};
+
+// Recycle Bin class using stack implementation.
+// Expiry is tracked in a min-heap on deletion time, and a background reaper
+// thread sleeps until the oldest entry is due, then purges expired entries in
+// batches. Deleting a file never scans the bin.
+// Once the files kept in RAM go over the memory budget, the oldest ones are
+// spilled to append-only segment files and read back only when restored.
+// Spilled entries stay at the bottom of the stack, so a segment holds files
+// deleted around the same time and is removed as a whole once its last entry
+// has expired or been restored.
+class RecycleBin
+{
+public:
+    DeletedFile* top;  // Pointer to top of stack
+    const int REAPER_BATCH_SIZE = 1024; // Entries purged per lock hold
+    const uint64_t SEGMENT_MAX_BYTES = 4 * 1024 * 1024; // A new segment is started after this size
+
+private:
+    // Append-only file holding spilled entries
+    struct SpillSegment
+    {
+        string path;
+        uint64_t bytes;     // Bytes written so far
+        size_t liveEntries; // Entries still in the bin
+    };
+
+    Timestamp retentionSeconds;   // How long deleted files are kept
+    vector<DeletedFile*> expiryHeap; // Min-heap on deletionTime
+    size_t entryCount;
+    long long purgedCount;        // Entries removed by the reaper
+    DeletedFile* bottom;          // Oldest entry in the stack
+    DeletedFile* spillFrontier;   // Newest spilled entry; every older entry is spilled too
+    size_t memoryBudget;          // Bytes of deleted files kept in RAM
+    size_t residentBytes;         // Bytes of deleted files currently in RAM
+    string spillPrefix;           // Segment files are named <prefix><process id>_<id>.seg
+    unordered_map<int, SpillSegment> segments;
+    int activeSegment;            // Segment new spills are appended to, or -1
+    int nextSegmentId;
+    ofstream activeStream;
+    unordered_map<string, DeletedFile*> byPath; // Original path -> newest entry, chained through samePath
+    unordered_map<Symbol, DeletedFile*> byName; // File name -> newest entry, chained through sameName
+    const MappedImage* image;     // Image that IMAGE_RECORD entries are read from
+    mutable mutex binMutex;       // Shared with the reaper thread
+    condition_variable reaperWake;
+    bool stopping;
+    bool purgesHeld;              // Set while the write-ahead log is replayed
+    thread reaper;
+
+    void heapSwap(size_t a, size_t b) {
+        swap(expiryHeap[a], expiryHeap[b]);
+        expiryHeap[a]->heapIndex = a;
+        expiryHeap[b]->heapIndex = b;
+    }
+
+    void siftUp(size_t index) {
+        while (index > 0 && expiryHeap[index]->deletionTime < expiryHeap[(index - 1) / 2]->deletionTime) {
+            heapSwap(index, (index - 1) / 2);
+            index = (index - 1) / 2;
+        }
+    }
+
+    void siftDown(size_t index) {
+        while (true) {
+            size_t smallest = index;
+            size_t left = 2 * index + 1;
+            size_t right = 2 * index + 2;
+            if (left < expiryHeap.size() && expiryHeap[left]->deletionTime < expiryHeap[smallest]->deletionTime) smallest = left;
+            if (right < expiryHeap.size() && expiryHeap[right]->deletionTime < expiryHeap[smallest]->deletionTime) smallest = right;
+            if (smallest == index) break;
+            heapSwap(index, smallest);
+            index = smallest;
+        }
+    }
+
+    void heapRemove(DeletedFile* entry) {
+        size_t index = entry->heapIndex;
+        heapSwap(index, expiryHeap.size() - 1);
+        expiryHeap.pop_back();
+        if (index < expiryHeap.size()) {
+            siftUp(index);
+            siftDown(index);
+        }
+    }
+
+    // Make an entry the newest one for its key in an index
+    template <typename Key>
+    static void indexAdd(unordered_map<Key, DeletedFile*>& index, const Key& key, DeletedFile* entry, DeletedFile::Chain DeletedFile::*chain) {
+        DeletedFile*& newest = index[key];
+        (entry->*chain).older = newest;
+        (entry->*chain).newer = nullptr;
+        if (newest) {
+            (newest->*chain).newer = entry;
+        }
+        newest = entry;
+    }
+
+    // Unlink an entry from the chain of its key in O(1)
+    template <typename Key>
+    static void indexRemove(unordered_map<Key, DeletedFile*>& index, const Key& key, DeletedFile* entry, DeletedFile::Chain DeletedFile::*chain) {
+        DeletedFile::Chain& links = entry->*chain;
+        if (links.older) {
+            (links.older->*chain).newer = links.newer;
+        }
+        if (links.newer) {
+            (links.newer->*chain).older = links.older;
+        } else if (links.older) {
+            index[key] = links.older;
+        } else {
+            index.erase(key);
+        }
+        links.older = links.newer = nullptr;
+    }
+
+    // Approximate memory held by a detached file and its version chain
+    static size_t footprint(const FileNode* file) {
+        size_t bytes = sizeof(FileNode);
+        for (FileVersion* ver = file->versions.head; ver; ver = ver->next) {
+            bytes += sizeof(FileVersion) + ver->content.size();
+        }
+        if (file->versions.tail && !file->versions.tail->isKeyframe) {
+            bytes += file->versions.latestContent.size();
+        }
+        return bytes;
+    }
+
+    // Drop a reference to a segment, deleting its file with the last one (caller holds binMutex)
+    void releaseSegment(int id) {
+        auto it = segments.find(id);
+        if (--it->second.liveEntries > 0) {
+            return;
+        }
+        if (id == activeSegment) {
+            activeStream.close();
+            activeSegment = -1;
+        }
+        remove(it->second.path.c_str());
+        segments.erase(it);
+    }
+
+    // Write an entry's file to the active segment and free it from RAM (caller holds binMutex)
+    bool spill(DeletedFile* entry) {
+        if (activeSegment == -1 || segments[activeSegment].bytes >= SEGMENT_MAX_BYTES) {
+            if (activeSegment != -1) {
+                activeStream.close();
+            }
+            int id = nextSegmentId++;
+            string path = spillPrefix + to_string(id) + ".seg";
+            activeStream.open(path, ios::binary | ios::trunc);
+            if (!activeStream) {
+                activeStream.clear();
+                activeSegment = -1;
+                return false;
+            }
+            segments[id] = {path, 0, 0};
+            activeSegment = id;
+        }
+        SpillSegment& segment = segments[activeSegment];
+        FileNode* file = entry->file;
+        saveFileNode(activeStream, file);
+        if (!activeStream) {
+            // The tail of the segment is unusable now; start a fresh one next time
+            activeStream.close();
+            activeStream.clear();
+            if (segment.liveEntries == 0) {
+                remove(segment.path.c_str());
+                segments.erase(activeSegment);
+            }
+            activeSegment = -1;
+            return false;
+        }
+        entry->segment = activeSegment;
+        entry->segmentOffset = segment.bytes;
+        segment.bytes = static_cast<uint64_t>(activeStream.tellp());
+        segment.liveEntries++;
+        residentBytes -= entry->memoryBytes;
+        file->versions.moveContentTo(entry->heldContent); // The record only names the chunks
+        fileNodePool.destroy(file);
+        entry->file = nullptr;
+        return true;
+    }
+
+    // Read a spilled entry's file back from its segment or the image, or
+    // nullptr on failure (caller holds binMutex). `imageRefs` is Counted to
+    // move an image record's chunk references to the file, Held for a copy.
+    FileNode* loadSpilled(const DeletedFile* entry, ContentRefs imageRefs) {
+        if (entry->segment == IMAGE_RECORD) {
+            if (!image) {
+                return nullptr;
+            }
+            MemoryBuffer record(image->at(entry->segmentOffset), entry->recordBytes);
+            istream in(&record);
+            return loadFileNode(in, imageRefs);
+        }
+        if (entry->segment == activeSegment) {
+            activeStream.flush();
+        }
+        ifstream in(segments[entry->segment].path, ios::binary);
+        in.seekg(entry->segmentOffset);
+        return loadFileNode(in, ContentRefs::Held);
+    }
+
+    // Spill the oldest files still in RAM until they fit the budget (caller holds binMutex)
+    void enforceBudget() {
+        bool spilled = false;
+        while (residentBytes > memoryBudget) {
+            DeletedFile* oldestResident = spillFrontier ? spillFrontier->prev : bottom;
+            if (!oldestResident || !spill(oldestResident)) {
+                break;
+            }
+            spillFrontier = oldestResident;
+            spilled = true;
+        }
+        if (spilled) {
+            activeStream.flush();
+        }
+    }
+
+    // Put an entry on top of the stack and into the heap and indexes (caller holds binMutex)
+    void link(DeletedFile* entry) {
+        entry->prev = nullptr;
+        entry->next = top;
+        if (top) {
+            top->prev = entry;
+        } else {
+            bottom = entry;
+        }
+        top = entry;
+        entry->heapIndex = expiryHeap.size();
+        expiryHeap.push_back(entry);
+        siftUp(entry->heapIndex);
+        indexAdd(byPath, entry->originalPath, entry, &DeletedFile::samePath);
+        indexAdd(byName, entry->name, entry, &DeletedFile::sameName);
+        entryCount++;
+        residentBytes += entry->memoryBytes;
+    }
+
+    // Take an entry off the stack, the expiry heap and the indexes, and drop
+    // its hold on RAM or its segment (caller holds binMutex)
+    void unlink(DeletedFile* entry) {
+        if (entry == bottom) {
+            bottom = entry->prev;
+        }
+        if (entry == spillFrontier) {
+            spillFrontier = entry->next;
+        }
+        if (entry->prev) {
+            entry->prev->next = entry->next;
+        } else {
+            top = entry->next;
+        }
+        if (entry->next) {
+            entry->next->prev = entry->prev;
+        }
+        entry->next = entry->prev = nullptr;
+        heapRemove(entry);
+        indexRemove(byPath, entry->originalPath, entry, &DeletedFile::samePath);
+        indexRemove(byName, entry->name, entry, &DeletedFile::sameName);
+        entryCount--;
+        if (entry->file) {
+            residentBytes -= entry->memoryBytes;
+        } else {
+            if (entry->segment != IMAGE_RECORD) {
+                releaseSegment(entry->segment);
+            }
+            entry->segment = -1;
+        }
+    }
+
+    // Purge up to REAPER_BATCH_SIZE expired entries (caller holds binMutex)
+    int purgeBatch(Timestamp now) {
+        int purged = 0;
+        while (purged < REAPER_BATCH_SIZE && !expiryHeap.empty() &&
+               now - expiryHeap[0]->deletionTime > retentionSeconds) {
+            DeletedFile* oldest = expiryHeap[0];
+            if (oldest->segment == IMAGE_RECORD && image) {
+                MemoryBuffer record(image->at(oldest->segmentOffset), oldest->recordBytes);
+                istream in(&record);
+                releaseFileRecord(in, ContentRefs::Counted); // The image's chunk table counts its references
+            }
+            unlink(oldest); // A spilled entry gives up its segment here
+            if (oldest->file) {
+                fileNodePool.destroy(oldest->file); // Frees the file and its versions
+            }
+            deletedFilePool.destroy(oldest);
+            purged++;
+        }
+        purgedCount += purged;
+        return purged;
+    }
+
+    // Background reaper: sleep until the oldest entry expires, then purge in batches
+    void reaperLoop() {
+        unique_lock<mutex> lock(binMutex);
+        while (!stopping) {
+            if (expiryHeap.empty() || purgesHeld) {
+                reaperWake.wait(lock);
+                continue;
+            }
+            Timestamp due = expiryHeap[0]->deletionTime + retentionSeconds + 1;
+            Timestamp now = currentTime();
+            if (due > now) {
+                reaperWake.wait_for(lock, chrono::seconds(due - now));
+                continue;
+            }
+            if (purgeBatch(now) == REAPER_BATCH_SIZE) {
+                lock.unlock(); // Let foreground operations in between batches
+                this_thread::yield();
+                lock.lock();
+            }
+        }
+    }
+
+public:
+    // Constructor to initialize recycle bin and start the reaper
+    RecycleBin(Timestamp retention = 60 * 60 * 24 * 7, // 7 days by default
+               size_t budget = 64 * 1024 * 1024,       // 64 MB of deleted files in RAM
+               const string& prefix = "recycle_bin_")
+    {
+        top = nullptr;
+        retentionSeconds = retention;
+        entryCount = 0;
+        purgedCount = 0;
+        bottom = spillFrontier = nullptr;
+        image = nullptr;
+        memoryBudget = budget;
+        residentBytes = 0;
+        spillPrefix = prefix + to_string(processId()) + "_"; // Another run in the same directory never reuses these names
+        activeSegment = -1;
+        nextSegmentId = 1;
+        stopping = false;
+        purgesHeld = false;
+        reaper = thread(&RecycleBin::reaperLoop, this);
+    }
+
+    // Destructor to stop the reaper and clean up deleted files
+    ~RecycleBin() {
+        {
+            lock_guard<mutex> lock(binMutex);
+            stopping = true;
+        }
+        reaperWake.notify_all();
+        reaper.join();
+        while (top) {
+            DeletedFile* nextFile = top->next;
+            if (top->file) {
+                fileNodePool.destroy(top->file);
+            }
+            deletedFilePool.destroy(top);
+            top = nextFile;
+        }
+        activeStream.close();
+        for (auto& segment : segments) {
+            remove(segment.second.path.c_str());
+        }
+    }
+
+    // Change how long deleted files are kept before automatic deletion
+    void setRetention(Timestamp seconds) {
+        {
+            lock_guard<mutex> lock(binMutex);
+            retentionSeconds = seconds;
+        }
+        reaperWake.notify_all();
+        cout << GREEN << "Recycle Bin retention set to " << seconds << " seconds." << RESET << endl;
+    }
+
+    Timestamp getRetention() const {
+        lock_guard<mutex> lock(binMutex);
+        return retentionSeconds;
+    }
+
+    // Change how many bytes of deleted files are kept in RAM; older ones spill to disk
+    void setMemoryBudget(size_t bytes) {
+        lock_guard<mutex> lock(binMutex);
+        memoryBudget = bytes;
+        enforceBudget();
+        cout << GREEN << "Recycle Bin memory budget set to " << bytes << " bytes (" << residentBytes
+             << " bytes in RAM, " << segments.size() << " segment(s) on disk)." << RESET << endl;
+    }
+
+    size_t getMemoryBudget() const {
+        lock_guard<mutex> lock(binMutex);
+        return memoryBudget;
+    }
+
+    // Stop or resume automatic purging. Replaying old deletions must not let
+    // the reaper purge files that a later record restores.
+    void holdPurges(bool held) {
+        {
+            lock_guard<mutex> lock(binMutex);
+            purgesHeld = held;
+        }
+        reaperWake.notify_all();
+    }
+
+    // Visit every entry from the oldest to the newest as (original path,
+    // deletion time, file). Spilled files are read back for the visit only.
+    template <typename Visit>
+    void forEachEntry(Visit visit) {
+        lock_guard<mutex> lock(binMutex);
+        for (DeletedFile* entry = bottom; entry; entry = entry->prev) {
+            FileNode* file = entry->file ? entry->file : loadSpilled(entry, ContentRefs::Held);
+            if (!file) {
+                continue;
+            }
+            visit(entry->originalPath, entry->deletionTime, file);
+            if (file != entry->file) {
+                fileNodePool.destroy(file);
+            }
+        }
+    }
+
+    // Content length of the entries whose files are still only records in the image
+    uint64_t imageContentBytes() {
+        lock_guard<mutex> lock(binMutex);
+        uint64_t total = 0;
+        FileRecordSummary summary;
+        for (DeletedFile* entry = bottom; entry && image; entry = entry->prev) {
+            if (entry->segment != IMAGE_RECORD) {
+                continue;
+            }
+            MemoryBuffer record(image->at(entry->segmentOffset), entry->recordBytes);
+            istream in(&record);
+            if (readFileSummary(in, summary)) {
+                total += summary.contentBytes;
+            }
+        }
+        return total;
+    }
+
+    // Write every entry, oldest first, for a new namespace image: each
+    // preceded by a 1 and the list ended by a 0. Records still only in the
+    // current image are copied as they are; `relocated` gets their new
+    // offsets, to apply with useImage() once the new image is mapped.
+    void save(ostream& out, vector<pair<DeletedFile*, uint64_t>>& relocated) {
+        lock_guard<mutex> lock(binMutex);
+        for (DeletedFile* entry = bottom; entry; entry = entry->prev) {
+            string saved;
+            if (entry->segment != IMAGE_RECORD) {
+                FileNode* file = entry->file ? entry->file : loadSpilled(entry, ContentRefs::Held);
+                if (!file) {
+                    continue;
+                }
+                ostringstream record;
+                saveFileNode(record, file);
+                saved = record.str();
+                if (file != entry->file) {
+                    fileNodePool.destroy(file);
+                }
+            } else if (!image) {
+                continue;
+            }
+            writeBinary<uint8_t>(out, 1);
+            writeBinaryString(out, entry->originalPath);
+            writeBinary<Timestamp>(out, entry->deletionTime);
+            writeBinary<int32_t>(out, entry->versionCount);
+            if (entry->segment == IMAGE_RECORD) {
+                writeBinary<uint64_t>(out, entry->recordBytes);
+                relocated.emplace_back(entry, static_cast<uint64_t>(out.tellp()));
+                out.write(image->at(entry->segmentOffset), entry->recordBytes);
+            } else {
+                writeBinary<uint64_t>(out, saved.length());
+                out.write(saved.data(), saved.length());
+            }
+        }
+        writeBinary<uint8_t>(out, 0);
+    }
+
+    // Add an entry whose file stays a record in the namespace image until
+    // it is restored or purged. Only at startup, oldest entry first.
+    void restore(Symbol name, const string& originalPath, Timestamp deletionTime, int versionCount, uint64_t offset, uint64_t bytes) {
+        DeletedFile* entry = deletedFilePool.create(name, originalPath, nullptr, deletionTime, nullptr);
+        entry->versionCount = versionCount;
+        entry->segment = IMAGE_RECORD;
+        entry->segmentOffset = offset;
+        entry->recordBytes = bytes;
+        {
+            lock_guard<mutex> lock(binMutex);
+            link(entry);
+            spillFrontier = entry; // Every older entry is in the image too
+        }
+        reaperWake.notify_all();
+    }
+
+    // Read IMAGE_RECORD entries from a newly mapped image (nullptr when it
+    // is closed), moving the entries in `relocated` to their new offsets
+    void useImage(const MappedImage* mapped, const vector<pair<DeletedFile*, uint64_t>>& relocated) {
+        lock_guard<mutex> lock(binMutex);
+        image = mapped;
+        for (const auto& entry : relocated) {
+            entry.first->segmentOffset = entry.second;
+        }
+    }
+
+    // Push a deleted file onto the stack; the bin takes ownership of the detached FileNode
+    void push(FileNode* file, const string& originalPath)
+    {
+        DeletedFile* entry = deletedFilePool.create(file->name, originalPath, file, currentTime(), nullptr);
+        entry->versionCount = file->versions.count();
+        entry->memoryBytes = footprint(file);
+        cout << GREEN << "File '" << symbols.str(file->name) << "' moved to Recycle Bin." << RESET << endl; // The file may be spilled below
+        bool newOldest;
+        {
+            lock_guard<mutex> lock(binMutex);
+            link(entry);
+            newOldest = (expiryHeap[0] == entry);
+            enforceBudget();
+        }
+        if (newOldest) {
+            reaperWake.notify_all(); // The reaper's next deadline changed
+        }
+    }
+
+    // View the most recently deleted file
+    void viewTop() {
+        lock_guard<mutex> lock(binMutex);
+        if (!top)
+        {
+            cout << RED << "Recycle Bin is empty" << RESET << endl;
+        }
+        else
+        {
+            cout << GREEN << "Last Deleted File: " << top->originalPath << " (" << top->versionCount << " version(s), Content: "
+                 << (top->file ? top->file->versions.latestContent.str() : "kept on disk") << ")" << RESET << endl;
+        }
+    }
+
+    // Take an entry out of the bin: the newest one for an original path (key
+    // containing '/') or file name, or the top of the stack if key is empty.
+    // A spilled file is read back from its segment first.
+    // Returns nullptr if nothing matches. Free the entry with release().
+    DeletedFile* take(const string& key) {
+        lock_guard<mutex> lock(binMutex);
+        DeletedFile* entry = top;
+        if (key.find('/') != string::npos) {
+            auto it = byPath.find(key);
+            entry = it == byPath.end() ? nullptr : it->second;
+        } else if (!key.empty()) {
+            auto it = byName.find(symbols.find(key));
+            entry = it == byName.end() ? nullptr : it->second;
+        }
+        if (!entry) {
+            return nullptr;
+        }
+        FileNode* file = entry->file;
+        if (!file) {
+            file = loadSpilled(entry, ContentRefs::Counted);
+            if (!file) {
+                cout << RED << "Could not read '" << entry->originalPath << "' back from disk." << RESET << endl;
+                return nullptr;
+            }
+        }
+        unlink(entry);
+        entry->file = file;
+        entry->memoryBytes = footprint(file);
+        entry->heldContent.clear(); // The loaded file holds the chunks now
+        return entry;
+    }
+
+    // Return an entry obtained from take() to the bin, keeping its deletion time
+    void putBack(DeletedFile* entry) {
+        {
+            lock_guard<mutex> lock(binMutex);
+            link(entry);
+            enforceBudget();
+        }
+        reaperWake.notify_all();
+    }
+
+    // Free an entry obtained from take(); its FileNode now belongs to the caller
+    void release(DeletedFile* entry) {
+        deletedFilePool.destroy(entry);
+    }
+
+    // Purge every expired file now (the reaper normally does this in the background)
+    void cleanUpOldFiles() {
+        lock_guard<mutex> lock(binMutex);
+        Timestamp now = currentTime();
+        while (purgeBatch(now) == REAPER_BATCH_SIZE) {}
+    }
+
+    void displayAll() {
+        lock_guard<mutex> lock(binMutex);
+        if (!top) {
+            cout << RED << "Recycle Bin is empty." << RESET << endl;
+        } else {
+            cout << CYAN << "Files in Recycle Bin (Most Recent First, " << entryCount << " total):" << RESET << endl;
+            DeletedFile* temp = top;
+            while (temp) {
+                cout << YELLOW << "Name: " << symbols.str(temp->name) << ", From: " << temp->originalPath
+                     << ", Versions: " << temp->versionCount << (temp->file ? "" : " (on disk)")
+                     << ", Deletion Time: " << formatTime(temp->deletionTime) << RESET << endl;
+                temp = temp->next;
+            }
+            cout << CYAN << "In RAM: " << residentBytes << " of " << memoryBudget << " bytes, on disk: "
+                 << segments.size() << " segment(s)" << RESET << endl;
+        }
+        if (purgedCount > 0) {
+            cout << YELLOW << purgedCount << " old file(s) automatically deleted from Recycle Bin." << RESET << endl;
+        }
+    }
+};
+
+// Recent Files list with LRU eviction: a doubly linked queue from least to
+// most recently used, plus a hash map from file identity to its queue node,
+// so touching, evicting or forgetting a file never scans the queue
+class FileQueue
+{
+public:
+    RecentFile* front;  // Front of queue (least recently used)
+    RecentFile* rear;   // Rear of queue (most recently used)
+    int size, capacity; // Current size and max capacity
+    unordered_map<uint64_t, RecentFile*> entries; // File identity -> queue node
+
+    // Constructor to initialize recent files queue
+    FileQueue(int cap = 256)
+    {
+        front = rear = nullptr;
+        size = 0;
+        capacity = cap;
+    }
+
+    FileQueue(const FileQueue&) = delete;
+    FileQueue& operator=(const FileQueue&) = delete;
+
+    // Destructor to clean up recent files
+    ~FileQueue() {
+        while (front) {
+            dequeue();
+        }
+    }
+
+    // Unlink a node from the queue without freeing it
+    void detach(RecentFile* file) {
+        if (file->prev) {
+            file->prev->next = file->next;
+        } else {
+            front = file->next;
+        }
+        if (file->next) {
+            file->next->prev = file->prev;
+        } else {
+            rear = file->prev;
+        }
+        file->prev = file->next = nullptr;
+    }
+
+    // Append a node at the rear (most recently used)
+    void append(RecentFile* file) {
+        file->prev = rear;
+        file->next = nullptr;
+        if (rear) {
+            rear->next = file;
+        } else {
+            front = file;
+        }
+        rear = file;
+    }
+
+    // Mark a file as most recently used (LRU logic: move to rear if already exists)
+    void enqueue(uint64_t fileId, const string& path)
+    {
+        auto it = entries.find(fileId);
+        if (it != entries.end()) {
+            RecentFile* file = it->second;
+            file->path = path; // The file may have been renamed or moved since
+            if (file != rear) {
+                detach(file);
+                append(file);
+            }
+            cout << YELLOW << "File '" << path << "' moved to end of Recent Files (LRU)." << RESET << endl;
+            return;
+        }
+
+        // File not found, add new
+        if (size == capacity)
+        {
+            dequeue(); // Remove the least recently used
+        }
+        if (capacity <= 0) {
+            return;
+        }
+        RecentFile* file = recentFilePool.create(fileId, path, nullptr, nullptr);
+        append(file);
+        entries[fileId] = file;
+        size++;
+        cout << GREEN << "File '" << path << "' added to Recent Files." << RESET << endl;
+    }
+
+    // Remove file from front of queue (least recently used)
+    void dequeue()
+    {
+        if (!front)
+        {
+            return;
+        }
+        forget(front->fileId);
+    }
+
+    // Drop a file from the list, e.g. after it was deleted
+    void forget(uint64_t fileId) {
+        auto it = entries.find(fileId);
+        if (it == entries.end()) {
+            return;
+        }
+        RecentFile* file = it->second;
+        entries.erase(it);
+        detach(file);
+        recentFilePool.destroy(file);
+        size--;
+    }
+
+    // Change the capacity, evicting the least recently used files that no longer fit
+    void setCapacity(int cap) {
+        capacity = max(cap, 0);
+        while (size > capacity) {
+            dequeue();
+        }
+    }
+
+    // Display all recent files
+    void display()
+    {
+        if (!front)
+        {
+            cout << RED << "No recent files." << RESET << endl;
+        }
+        else
+        {
+            cout << CYAN << "Recent Files (Least Recent to Most Recent, " << size << " of " << capacity << "):" << RESET << endl;
+            RecentFile* temp = front;
+            while (temp)
+            {
+                cout << YELLOW << temp->path << RESET << endl;
+                temp = temp->next;
+            }
+        }
+    }
+};
+
+// User Authentication system using linked list, with a hash index from
+// username to account so every lookup is a single probe. Login returns the
+// account itself as the session's user handle.
+class UserAuth
+{
+public:
+    UserNode* head;  // Pointer to first user
+    unordered_map<Symbol, UserNode*> directory; // Username -> account
+    uint32_t nextUserId;
+
+    // Constructor to initialize user authentication system
+    UserAuth()
+    {
+        head = nullptr;
+        nextUserId = 1;
+    }
+
+    // Destructor to clean up user nodes
+    ~UserAuth() {
+        while (head) {
+            UserNode* nextUser = head->next;
+            userPool.destroy(head);
+            head = nextUser;
+        }
+    }
+
+    // Find an account by username, or nullptr
+    UserNode* find(const string& username) const {
+        auto it = directory.find(symbols.find(username));
+        return it == directory.end() ? nullptr : it->second;
+    }
+
+    // Register a new user; returns the new account, or nullptr
+    UserNode* signup(string username, string password, string role, string secAns)
+    {
+        if (find(username))
+        {
+            cout << RED << "Username already exists. Please choose a different username." << RESET << endl;
+            return nullptr;
+        }
+        // Validate role input
+        Role parsedRole = parseRole(role);
+        if (parsedRole == Role::None) {
+            cout << RED << "Invalid role specified. Please use 'admin', 'editor', or 'viewer'." << RESET << endl;
+            return nullptr;
+        }
+        string salt = newSalt();
+        UserNode* user = addAccount(username, parsedRole, salt, hashCredential(salt, password), hashCredential(salt, secAns));
+        cout << GREEN << "Signup successful! Welcome, " << username << "!" << RESET << endl;
+        return user;
+    }
+
+    // Add an account whose credentials are already hashed, with the next free ID
+    UserNode* addAccount(const string& username, Role role, const string& salt, const string& passwordHash, const string& answerHash)
+    {
+        head = userPool.create(nextUserId++, symbols.intern(username), salt, passwordHash, role, answerHash, Timestamp(0), head);
+        directory[head->username] = head;
+        return head;
+    }
+
+    // Recreate an account exactly as it was saved in the namespace image, keeping its ID.
+    // An account that already exists (the default admin) takes the saved fields.
+    UserNode* restoreAccount(uint32_t id, const string& username, const string& salt, const string& passwordHash, Role role,
+                             const string& answerHash, Timestamp lastLogout)
+    {
+        UserNode* user = find(username);
+        if (!user) {
+            head = userPool.create(id, symbols.intern(username), salt, passwordHash, role, answerHash, lastLogout, head);
+            directory[head->username] = head;
+            user = head;
+        }
+        user->id = id;
+        user->salt = salt;
+        user->passwordHash = passwordHash;
+        user->role = role;
+        user->answerHash = answerHash;
+        user->lastLogout = lastLogout;
+        nextUserId = max(nextUserId, id + 1);
+        return user;
+    }
+
+    // Authenticate user login; returns the user's account, or nullptr
+    UserNode* login(const string& username, const string& password)
+    {
+        UserNode* user = find(username);
+        if (user && credentialMatches(user->salt, password, user->passwordHash))
+        {
+            cout << GREEN << "Login successful!" << RESET << endl;
+            return user;
+        }
+        cout << RED << "Invalid username or password." << RESET << endl;
+        return nullptr;
+    }
+
+    // Password recovery using security question. Only a hash of the password
+    // is kept, so a correct answer lets the user choose a new one instead.
+    bool forgot(const string& username, const string& ans)
+    {
+        UserNode* user = find(username);
+        if (user && credentialMatches(user->salt, ans, user->answerHash))
+        {
+            cout << GREEN << "Security answer accepted." << RESET << endl;
+            return true;
+        }
+        cout << RED << "Invalid username or security answer." << RESET << endl;
+        return false;
+    }
+
+    // Give a user a new password, hashed with a new salt (the answer is rehashed with it)
+    void setPassword(UserNode* user, const string& password, const string& ans)
+    {
+        user->salt = newSalt();
+        user->passwordHash = hashCredential(user->salt, password);
+        user->answerHash = hashCredential(user->salt, ans);
+        cout << GREEN << "Password changed. You can log in with the new password." << RESET << endl;
+    }
+
+    // Record logout time for user
+    void logout(UserNode* user)
+    {
+        user->lastLogout = currentTime();
+    }
+
+    // Get user role
+    Role getUserRole(const string& username) const {
+        UserNode* user = find(username);
+        return user ? user->role : Role::None; // None if user not found
+    }
+};
+
+// Names of the permissions in a mask, e.g. "read, write"
+string permissionNames(PermissionMask mask) {
+    string names;
+    const char* labels[] = {"read", "write", "execute"};
+    for (int bit = 0; bit < 3; bit++) {
+        if (mask & (1 << bit)) {
+            names += (names.empty() ? "" : ", ") + string(labels[bit]);
+        }
+    }
+    return names;
+}
+
+// Graph-based user connections for file sharing. Every share is one edge,
+// kept in both the owner's outbound and the receiver's inbound adjacency,
+// so "shared by me", "shared with me" and permission lookups only look at
+// the user's own edges. Shares may target groups, which nest, and folders,
+// which pass their shares down to everything below them. The groups a user
+// reaches through nested membership are cached per user; a membership change
+// only drops the cached entries of the users it can affect.
+class UserGraph
+{
+public:
+    UserGraphNode* head;
+    unordered_map<uint32_t, UserGraphNode*> nodes; // Graph ID -> user or group node
+    unordered_map<string, uint32_t> groupIds;      // Group name -> graph ID
+    uint32_t nextGroupId;
+    long long reachHits, reachMisses;
+
+private:
+    unordered_map<uint32_t, vector<uint32_t>> reachCache;         // User -> the user and every group it reaches
+    unordered_map<uint32_t, unordered_set<uint32_t>> reachedFrom; // Group -> users whose cached entry holds it
+
+    // Drop a user's cached reachable groups
+    void invalidateUser(uint32_t userId) {
+        auto it = reachCache.find(userId);
+        if (it == reachCache.end()) {
+            return;
+        }
+        for (uint32_t groupId : it->second) {
+            auto users = reachedFrom.find(groupId);
+            if (users != reachedFrom.end()) {
+                users->second.erase(userId);
+                if (users->second.empty()) {
+                    reachedFrom.erase(users);
+                }
+            }
+        }
+        reachCache.erase(it);
+    }
+
+    // Drop the cached entries a membership change of this user or group can affect
+    void invalidateReach(uint32_t id) {
+        if (!(id & GROUP_ID_FLAG)) {
+            invalidateUser(id);
+            return;
+        }
+        auto users = reachedFrom.find(id);
+        if (users == reachedFrom.end()) {
+            return;
+        }
+        vector<uint32_t> affected(users->second.begin(), users->second.end());
+        for (uint32_t userId : affected) {
+            invalidateUser(userId);
+        }
+    }
+
+    // True if `target` is `group` or is nested somewhere inside it
+    bool containsGroup(uint32_t group, uint32_t target) const {
+        vector<uint32_t> stack = {group};
+        unordered_set<uint32_t> seen = {group};
+        while (!stack.empty()) {
+            uint32_t id = stack.back();
+            stack.pop_back();
+            if (id == target) {
+                return true;
+            }
+            for (uint32_t member : nodes.at(id)->members) {
+                if ((member & GROUP_ID_FLAG) && seen.insert(member).second) {
+                    stack.push_back(member);
+                }
+            }
+        }
+        return false;
+    }
+
+public:
+    UserGraph()
+    {
+        head = nullptr;
+        nextGroupId = 1;
+        reachHits = reachMisses = 0;
+    }
+
+    // Destructor to clean up user graph nodes and share edges
+    ~UserGraph() {
+        while (head) {
+            UserGraphNode* nextUser = head->next;
+            for (auto& object : head->outbound) {
+                for (auto& share : object.second) {
+                    shareEdgePool.destroy(share.second);
+                }
+            }
+            userGraphPool.destroy(head);
+            head = nextUser;
+        }
+    }
+
+    // Add a new user to the graph
+    void addUser(uint32_t id, const string& username)
+    {
+        if (nodes.count(id)) {
+            return;
+        }
+        UserGraphNode* newUser = userGraphPool.create(id, symbols.intern(username));
+        newUser->next = head;
+        head = newUser;
+        nodes[id] = newUser;
+        cout << GREEN << "User '" << username << "' added to user graph for sharing." << RESET << endl;
+    }
+
+    // Helper to find a user or group in the graph
+    UserGraphNode* findUserNode(uint32_t id) const {
+        auto it = nodes.find(id);
+        return it == nodes.end() ? nullptr : it->second;
+    }
+
+    // Graph ID of a group, or 0 if there is none by that name
+    uint32_t findGroup(const string& name) const {
+        auto it = groupIds.find(name);
+        return it == groupIds.end() ? 0 : it->second;
+    }
+
+    // Create an empty group owned by a user; returns its graph ID, or 0 if the name is taken
+    uint32_t createGroup(uint32_t ownerId, const string& name)
+    {
+        if (name.empty() || groupIds.count(name)) {
+            cout << RED << "Group '" << name << "' already exists or the name is empty." << RESET << endl;
+            return 0;
+        }
+        uint32_t id = GROUP_ID_FLAG | nextGroupId++;
+        UserGraphNode* group = userGraphPool.create(id, symbols.intern("@" + name));
+        group->ownerId = ownerId;
+        group->next = head;
+        head = group;
+        nodes[id] = group;
+        groupIds[name] = id;
+        cout << GREEN << "Group '@" << name << "' created." << RESET << endl;
+        return id;
+    }
+
+    // Recreate a group saved in the namespace image, keeping its graph ID
+    void restoreGroup(uint32_t id, const string& name, uint32_t ownerId)
+    {
+        UserGraphNode* group = userGraphPool.create(id, symbols.intern("@" + name));
+        group->ownerId = ownerId;
+        group->next = head;
+        head = group;
+        nodes[id] = group;
+        groupIds[name] = id;
+        nextGroupId = max(nextGroupId, (id & ~GROUP_ID_FLAG) + 1);
+    }
+
+    // Add a user or group to a group; nesting a group inside itself is refused
+    bool addMember(uint32_t groupId, uint32_t memberId)
+    {
+        UserGraphNode* group = findUserNode(groupId);
+        UserGraphNode* member = findUserNode(memberId);
+        if (!group || !member || !(groupId & GROUP_ID_FLAG)) {
+            cout << RED << "Group or member not found." << RESET << endl;
+            return false;
+        }
+        if ((memberId & GROUP_ID_FLAG) && containsGroup(memberId, groupId)) {
+            cout << RED << "Cannot add " << symbols.str(member->username) << " to " << symbols.str(group->username) << ": groups would contain each other." << RESET << endl;
+            return false;
+        }
+        if (!group->members.insert(memberId).second) {
+            cout << YELLOW << symbols.str(member->username) << " is already in " << symbols.str(group->username) << "." << RESET << endl;
+            return false;
+        }
+        member->memberOf.insert(groupId);
+        invalidateReach(memberId);
+        cout << GREEN << symbols.str(member->username) << " added to " << symbols.str(group->username) << "." << RESET << endl;
+        return true;
+    }
+
+    // Remove a user or group from a group
+    bool removeMember(uint32_t groupId, uint32_t memberId)
+    {
+        UserGraphNode* group = findUserNode(groupId);
+        UserGraphNode* member = findUserNode(memberId);
+        if (!group || !member || !group->members.erase(memberId)) {
+            cout << RED << "Not a member of that group." << RESET << endl;
+            return false;
+        }
+        member->memberOf.erase(groupId);
+        invalidateReach(memberId);
+        cout << GREEN << symbols.str(member->username) << " removed from " << symbols.str(group->username) << "." << RESET << endl;
+        return true;
+    }
+
+    // The user itself plus every group it belongs to, directly or through nested groups
+    const vector<uint32_t>& principalsOf(uint32_t userId)
+    {
+        auto cached = reachCache.find(userId);
+        if (cached != reachCache.end()) {
+            reachHits++;
+            return cached->second;
+        }
+        reachMisses++;
+        vector<uint32_t>& reached = reachCache[userId];
+        reached.push_back(userId);
+        unordered_set<uint32_t> seen = {userId};
+        for (size_t i = 0; i < reached.size(); i++) { // Breadth-first over memberOf
+            UserGraphNode* node = findUserNode(reached[i]);
+            if (!node) {
+                continue;
+            }
+            for (uint32_t groupId : node->memberOf) {
+                if (seen.insert(groupId).second) {
+                    reached.push_back(groupId);
+                    reachedFrom[groupId].insert(userId);
+                }
+            }
+        }
+        return reached;
+    }
+
+    // Add permissions to the share of an object from one node to another,
+    // creating the edge in both adjacencies if needed
+    ShareEdge* grant(UserGraphNode* ownerNode, UserGraphNode* receiverNode, uint64_t objectKey, const string& path, PermissionMask mask)
+    {
+        ShareEdge*& edge = ownerNode->outbound[objectKey][receiverNode->id];
+        if (!edge) {
+            edge = shareEdgePool.create(ownerNode->id, receiverNode->id, objectKey, path, PermissionMask(0));
+            receiverNode->inbound[objectKey][ownerNode->id] = edge;
+            ownerNode->outboundCount++;
+            receiverNode->inboundCount++;
+        }
+        edge->path = path;
+        edge->permissions |= mask;
+        return edge;
+    }
+
+    // Share a file or folder with a user or group; sharing it again adds the permission to the existing share
+    bool shareFile(uint32_t ownerId, uint32_t receiverId, uint64_t objectKey, const string& path, const string& permission)
+    {
+        UserGraphNode* ownerNode = findUserNode(ownerId);
+        UserGraphNode* receiverNode = findUserNode(receiverId);
+
+        if (!ownerNode) {
+            cout << RED << "Owner user not found in graph." << RESET << endl;
+            return false;
+        }
+        if (!receiverNode) {
+            cout << RED << "Receiver not found in graph." << RESET << endl;
+            return false;
+        }
+
+        // Simple permission validation
+        PermissionMask mask = parsePermission(permission);
+        if (!mask) {
+            cout << RED << "Invalid permission. Use 'read', 'write', or 'execute'." << RESET << endl;
+            return false;
+        }
+
+        ShareEdge* edge = grant(ownerNode, receiverNode, objectKey, path, mask);
+        cout << GREEN << (objectKey & FOLDER_KEY_FLAG ? "Folder '" : "File '") << path << "' shared by " << symbols.str(ownerNode->username)
+             << " with " << symbols.str(receiverNode->username) << " with permission: " << permissionNames(edge->permissions) << RESET << endl;
+        return true;
+    }
+
+    // Remove a share from both the owner's and the receiver's adjacency
+    bool revokeShare(uint32_t ownerId, uint32_t receiverId, uint64_t objectKey)
+    {
+        UserGraphNode* ownerNode = findUserNode(ownerId);
+        UserGraphNode* receiverNode = findUserNode(receiverId);
+        if (!ownerNode || !receiverNode) {
+            return false;
+        }
+        auto object = ownerNode->outbound.find(objectKey);
+        if (object == ownerNode->outbound.end()) {
+            return false;
+        }
+        auto share = object->second.find(receiverId);
+        if (share == object->second.end()) {
+            return false;
+        }
+        ShareEdge* edge = share->second;
+        object->second.erase(share);
+        if (object->second.empty()) {
+            ownerNode->outbound.erase(object);
+        }
+        auto inboundObject = receiverNode->inbound.find(objectKey);
+        inboundObject->second.erase(ownerId);
+        if (inboundObject->second.empty()) {
+            receiverNode->inbound.erase(inboundObject);
+        }
+        ownerNode->outboundCount--;
+        receiverNode->inboundCount--;
+        shareEdgePool.destroy(edge);
+        return true;
+    }
+
+    // Permissions shared with a user, directly or through its groups, on any
+    // of the given objects (a file and the folders above it)
+    PermissionMask sharedPermissions(const vector<uint64_t>& objectKeys, uint32_t userId) {
+        PermissionMask mask = 0;
+        for (uint32_t principal : principalsOf(userId)) {
+            UserGraphNode* node = findUserNode(principal);
+            if (!node || node->inbound.empty()) {
+                continue;
+            }
+            for (uint64_t key : objectKeys) {
+                auto object = node->inbound.find(key);
+                if (object == node->inbound.end()) {
+                    continue;
+                }
+                for (const auto& share : object->second) {
+                    mask |= share.second->permissions;
+                }
+            }
+        }
+        return mask;
+    }
+
+    // Display shared files for a user (files they have shared with others)
+    void displaySharedFiles(uint32_t userId)
+    {
+        UserGraphNode* curr = findUserNode(userId);
+        if (!curr)
+        {
+            cout << RED << "User not found." << RESET << endl;
+            return;
+        }
+
+        if (curr->outbound.empty()) {
+            cout << YELLOW << symbols.str(curr->username) << " has not shared any files." << RESET << endl;
+            return;
+        }
+
+        cout << CYAN << "Files shared by " << symbols.str(curr->username) << " (" << curr->outboundCount << "):" << RESET << endl;
+        for (const auto& object : curr->outbound)
+        {
+            for (const auto& share : object.second)
+            {
+                cout << YELLOW << "-> Shared with: " << symbols.str(nodes.at(share.first)->username)
+                     << (object.first & FOLDER_KEY_FLAG ? ", Folder: " : ", File: ") << share.second->path
+                     << ", Permission: " << permissionNames(share.second->permissions) << RESET << endl;
+            }
+        }
+    }
+
+    // Display files shared *with* a user (inbound shares), including through groups
+    void displayFilesSharedWithMe(uint32_t userId) {
+        UserGraphNode* curr = findUserNode(userId);
+        if (!curr) {
+            cout << RED << "User not found." << RESET << endl;
+            return;
+        }
+
+        bool foundShares = false;
+        cout << CYAN << "Files shared with " << symbols.str(curr->username) << ":" << RESET << endl;
+        for (uint32_t principal : principalsOf(userId)) {
+            UserGraphNode* node = findUserNode(principal);
+            for (const auto& object : node->inbound) {
+                for (const auto& share : object.second) {
+                    cout << YELLOW << "<- From: " << symbols.str(nodes.at(share.first)->username)
+                         << (object.first & FOLDER_KEY_FLAG ? ", Folder: " : ", File: ") << share.second->path
+                         << ", Permission: " << permissionNames(share.second->permissions)
+                         << (principal == userId ? "" : ", Via: " + symbols.str(node->username)) << RESET << endl;
+                    foundShares = true;
+                }
+            }
+        }
+
+        if (!foundShares) {
+            cout << YELLOW << "No files have been shared with " << symbols.str(curr->username) << "." << RESET << endl;
+        }
+    }
+};
+
+// Split a path into its non-empty components
+vector<string> splitPath(const string& path)
+{
+    vector<string> parts;
+    size_t start = 0;
+    while (start <= path.length()) {
+        size_t slash = path.find('/', start);
+        if (slash == string::npos) {
+            slash = path.length();
+        }
+        if (slash > start) {
+            parts.push_back(path.substr(start, slash - start));
+        }
+        start = slash + 1;
+    }
+    return parts;
+}
+
+// Bounded cache of absolute folder paths to folder nodes (least recently used evicted first)
+class DentryCache
+{
+private:
+    typedef list<pair<string, FolderNode*>> EntryList;
+    EntryList entries;                                    // Most recently used first
+    unordered_map<string, EntryList::iterator> lookupTable; // Path -> entry
+    size_t capacity;
+
+public:
+    long long hits, misses;
+
+    DentryCache(size_t cap = 4096) : capacity(cap), hits(0), misses(0) {}
+
+    // Find a cached folder, or nullptr on a miss
+    FolderNode* lookup(const string& path) {
+        auto it = lookupTable.find(path);
+        if (it == lookupTable.end()) {
+            misses++;
+            return nullptr;
+        }
+        hits++;
+        entries.splice(entries.begin(), entries, it->second); // Mark as most recently used
+        return it->second->second;
+    }
+
+    // Remember the folder a path resolved to
+    void insert(const string& path, FolderNode* folder) {
+        auto it = lookupTable.find(path);
+        if (it != lookupTable.end()) {
+            it->second->second = folder;
+            entries.splice(entries.begin(), entries, it->second);
+            return;
+        }
+        if (entries.size() == capacity) {
+            lookupTable.erase(entries.back().first);
+            entries.pop_back();
+        }
+        entries.emplace_front(path, folder);
+        lookupTable[path] = entries.begin();
+    }
+
+    // Drop a path and every path below it (after delete, rename or move)
+    void invalidatePrefix(const string& path) {
+        for (auto it = entries.begin(); it != entries.end();) {
+            const string& key = it->first;
+            if (key.compare(0, path.length(), path) == 0 && (key.length() == path.length() || key[path.length()] == '/')) {
+                lookupTable.erase(key);
+                it = entries.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+};
+
+// Byte-budgeted cache of the materialized latest content of files, keyed by
+// file identity. Entries are kept in least recently used order; admission
+// follows TinyLFU: a count-min sketch estimates how often each file is read,
+// and a file only displaces cached entries that are read less often than it.
+class ContentCache
+{
+private:
+    struct Entry
+    {
+        uint64_t fileId;
+        string content;
+    };
+    typedef list<Entry> EntryList;
+    EntryList entries;                                        // Most recently used first
+    unordered_map<uint64_t, EntryList::iterator> lookupTable; // File identity -> entry
+    size_t budget;    // Bytes of content the cache may hold
+    size_t usedBytes; // Bytes of content currently cached
+
+    static const int SKETCH_DEPTH = 4;  // Independent counter rows
+    vector<uint8_t> sketch;             // SKETCH_DEPTH rows of sketchWidth saturating counters
+    size_t sketchWidth;                 // Counters per row (power of two)
+    size_t samples;                     // Reads recorded since the last aging pass
+    size_t sampleLimit;                 // Counters are halved after this many reads
+
+    size_t sketchSlot(uint64_t fileId, int row) const {
+        return row * sketchWidth + (mixHash(fileId + (row + 1) * 0x9E3779B97F4A7C15ULL) & (sketchWidth - 1));
+    }
+
+    // Count one read of a file, halving every counter now and then so old popularity fades
+    void recordAccess(uint64_t fileId) {
+        for (int row = 0; row < SKETCH_DEPTH; row++) {
+            uint8_t& counter = sketch[sketchSlot(fileId, row)];
+            if (counter < 255) {
+                counter++;
+            }
+        }
+        if (++samples >= sampleLimit) {
+            for (uint8_t& counter : sketch) {
+                counter >>= 1;
+            }
+            samples /= 2;
+        }
+    }
+
+    // Estimated read frequency of a file (never an underestimate before aging)
+    int frequency(uint64_t fileId) const {
+        int estimate = 255;
+        for (int row = 0; row < SKETCH_DEPTH; row++) {
+            estimate = min(estimate, static_cast<int>(sketch[sketchSlot(fileId, row)]));
+        }
+        return estimate;
+    }
+
+    void evictLast() {
+        usedBytes -= entries.back().content.length();
+        lookupTable.erase(entries.back().fileId);
+        entries.pop_back();
+        evictions++;
+    }
+
+public:
+    long long hits, misses, rejected, evictions;
+
+    ContentCache(size_t budgetBytes = 16 * 1024 * 1024, size_t sketchCounters = 1 << 16)
+        : budget(budgetBytes), usedBytes(0), sketch(SKETCH_DEPTH * sketchCounters, 0), sketchWidth(sketchCounters),
+          samples(0), sampleLimit(10 * sketchCounters), hits(0), misses(0), rejected(0), evictions(0) {}
+
+    // Cached content of a file, or nullptr on a miss. The pointer stays valid
+    // until the cache is next changed.
+    const string* lookup(uint64_t fileId) {
+        recordAccess(fileId);
+        auto it = lookupTable.find(fileId);
+        if (it == lookupTable.end()) {
+            misses++;
+            return nullptr;
+        }
+        hits++;
+        entries.splice(entries.begin(), entries, it->second); // Mark as most recently used
+        return &it->second->content;
+    }
+
+    // Offer the content of a file that just missed; it is cached only if it
+    // fits and is read more often than every entry it would evict
+    void insert(uint64_t fileId, string content) {
+        if (content.length() > budget || lookupTable.count(fileId)) {
+            rejected++;
+            return;
+        }
+        int candidateFrequency = frequency(fileId);
+        size_t freed = 0;
+        auto victim = entries.end();
+        while (usedBytes - freed + content.length() > budget) {
+            --victim;
+            if (frequency(victim->fileId) >= candidateFrequency) {
+                rejected++; // The cached files are hotter than this one
+                return;
+            }
+            freed += victim->content.length();
+        }
+        while (usedBytes + content.length() > budget) {
+            evictLast();
+        }
+        usedBytes += content.length();
+        entries.push_front({fileId, move(content)});
+        lookupTable[fileId] = entries.begin();
+    }
+
+    // Drop a file's content after it changed or the file was deleted
+    void invalidate(uint64_t fileId) {
+        auto it = lookupTable.find(fileId);
+        if (it == lookupTable.end()) {
+            return;
+        }
+        usedBytes -= it->second->content.length();
+        entries.erase(it->second);
+        lookupTable.erase(it);
+    }
+
+    // Change the byte budget, evicting least recently used entries that no longer fit
+    void setBudget(size_t bytes) {
+        budget = bytes;
+        while (usedBytes > budget) {
+            evictLast();
+        }
+        cout << GREEN << "Content cache budget set to " << bytes << " bytes (" << entries.size() << " file(s), "
+             << usedBytes << " bytes cached)." << RESET << endl;
+    }
+
+    size_t getBudget() const {
+        return budget;
+    }
+
+    void displayStats() const {
+        long long lookups = hits + misses;
+        cout << CYAN << "Content Cache: " << entries.size() << " file(s), " << usedBytes << " of " << budget << " bytes"
+             << "\nHits: " << hits << ", Misses: " << misses << ", Hit rate: "
+             << (lookups ? 100.0 * hits / lookups : 0.0) << "%"
+             << "\nRejected by admission: " << rejected << ", Evicted: " << evictions << RESET << endl;
+    }
+};
+
+// Operations recorded in the write-ahead log
+enum class JournalOp : uint8_t {
+    Signup = 1, CreateFolder, CreateFile, UpdateFile, RollbackFile, RollbackFileToVersion,
+    DeleteFile, RestoreFile, DeleteFolder, RenameFolder, MoveFolder, ShareFile, ShareFolder,
+    RevokeShare, CreateGroup, AddGroupMember, RemoveGroupMember, SetPriority, SetRetention,
+    Logout, ResetPassword,
+    CreateFileChunks, UpdateFileChunks // As CreateFile and UpdateFile, with the content as chunk references
+};
+
+// One logged operation: who did it, when, and its arguments (paths are absolute)
+struct JournalRecord {
+    uint64_t lsn = 0;       // Log sequence number, increasing across checkpoints
+    JournalOp op = JournalOp::Signup;
+    Timestamp time = 0;
+    string actor;           // User who performed it ("" for signup and password reset)
+    vector<string> args;
+    int64_t number = 0;     // Priority, version number or retention, depending on op
+};
+
+// Append-only write-ahead log with group commit. Records are framed as
+// length + checksum + payload and handed to a background flusher, which
+// gathers everything appended within one commit window and makes the batch
+// durable with a single write and fsync. Appending never waits for the disk;
+// sync() waits until everything appended so far is durable. A crash loses at
+// most the last commit window of operations; a torn record at the end of the
+// log is detected by its checksum and ignored on replay.
+class WriteAheadLog
+{
+public:
+    const size_t GROUP_COMMIT_BYTES = 1024 * 1024; // Flush a batch early once this much is waiting
+
+private:
+    string path;
+    FILE* file;
+    string pending;            // Framed records not yet handed to the disk
+    uint64_t lastLsn;          // Last sequence number appended
+    uint64_t durableLsn;       // Last sequence number known to be on disk
+    chrono::milliseconds commitWindow;
+    long long appendCount, flushCount;
+    uint64_t bytesWritten;
+    bool failed;               // A write or fsync failed; the log is no longer trustworthy
+    bool stopping;
+    mutex logMutex;
+    condition_variable flusherWake, durableWake;
+    thread flusher;
+
+    // Background flusher: wait for records, let the batch fill for one commit window, then write and fsync it
+    void flusherLoop() {
+        unique_lock<mutex> lock(logMutex);
+        while (true) {
+            flusherWake.wait(lock, [this] { return stopping || !pending.empty(); });
+            if (pending.empty()) {
+                break; // Stopping with nothing left to write
+            }
+            if (!stopping && pending.size() < GROUP_COMMIT_BYTES) {
+                flusherWake.wait_for(lock, commitWindow, [this] { return stopping || pending.size() >= GROUP_COMMIT_BYTES; });
+            }
+            string batch;
+            batch.swap(pending);
+            uint64_t batchLsn = lastLsn;
+            FILE* target = file;
+            lock.unlock();
+            // Records may refer to chunks, so those must reach the disk first
+            bool written = blobStore.sync() && fwrite(batch.data(), 1, batch.size(), target) == batch.size() &&
+                           fflush(target) == 0 && syncToDisk(target);
+            lock.lock();
+            failed = failed || !written;
+            durableLsn = batchLsn;
+            flushCount++;
+            bytesWritten += batch.size();
+            durableWake.notify_all();
+        }
+    }
+
+    static string encode(const JournalRecord& record) {
+        ostringstream out;
+        writeBinary<uint64_t>(out, record.lsn);
+        writeBinary<uint8_t>(out, static_cast<uint8_t>(record.op));
+        writeBinary<Timestamp>(out, record.time);
+        writeBinaryString(out, record.actor);
+        writeBinary<uint32_t>(out, static_cast<uint32_t>(record.args.size()));
+        for (const string& arg : record.args) {
+            writeBinaryString(out, arg);
+        }
+        writeBinary<int64_t>(out, record.number);
+        return out.str();
+    }
+
+    static bool decode(const string& payload, JournalRecord& record) {
+        istringstream in(payload);
+        uint8_t op;
+        uint32_t argCount;
+        if (!readBinary(in, record.lsn) || !readBinary(in, op) || !readBinary(in, record.time) ||
+            !readBinaryString(in, record.actor) || !readBinary(in, argCount)) {
+            return false;
+        }
+        record.op = static_cast<JournalOp>(op);
+        record.args.assign(argCount, "");
+        for (string& arg : record.args) {
+            if (!readBinaryString(in, arg)) {
+                return false;
+            }
+        }
+        return readBinary(in, record.number);
+    }
+
+public:
+    // Open a log for appending; sequence numbers continue after `lsn`
+    WriteAheadLog(const string& logPath, uint64_t lsn, chrono::milliseconds window = chrono::milliseconds(5))
+        : path(logPath), lastLsn(lsn), durableLsn(lsn), commitWindow(window)
+    {
+        file = fopen(path.c_str(), "ab");
+        appendCount = flushCount = 0;
+        bytesWritten = 0;
+        failed = (file == nullptr);
+        stopping = false;
+        flusher = thread(&WriteAheadLog::flusherLoop, this);
+    }
+
+    // Destructor: flush whatever is still pending, then close the log
+    ~WriteAheadLog() {
+        {
+            lock_guard<mutex> lock(logMutex);
+            stopping = true;
+        }
+        flusherWake.notify_all();
+        flusher.join();
+        if (file) {
+            fclose(file);
+        }
+    }
+
+    bool isOpen() const { return file != nullptr; }
+
+    // Queue a record for the next group commit; returns its sequence number,
+    // or 0 if the log is closed or a write failed, so the record cannot be saved
+    // (replay would stop at the failed write anyway)
+    uint64_t append(JournalRecord record) {
+        lock_guard<mutex> lock(logMutex);
+        if (!file || failed) {
+            return 0;
+        }
+        record.lsn = ++lastLsn;
+        string payload = encode(record);
+        uint32_t length = static_cast<uint32_t>(payload.size());
+        uint64_t checksum = hashBytes(payload.data(), payload.size());
+        pending.append(reinterpret_cast<const char*>(&length), sizeof(length));
+        pending.append(reinterpret_cast<const char*>(&checksum), sizeof(checksum));
+        pending += payload;
+        appendCount++;
+        flusherWake.notify_one();
+        return record.lsn;
+    }
+
+    // Wait until every record appended so far is on disk; false if a write failed
+    bool sync() {
+        unique_lock<mutex> lock(logMutex);
+        flusherWake.notify_one();
+        durableWake.wait(lock, [this] { return durableLsn == lastLsn; });
+        return !failed;
+    }
+
+    uint64_t lastSequence() {
+        lock_guard<mutex> lock(logMutex);
+        return lastLsn;
+    }
+
+    // Empty the log after a checkpoint has captured everything in it. False
+    // if it could not be reopened (nothing is logged from then on) or synced.
+    bool truncate() {
+        sync();
+        lock_guard<mutex> lock(logMutex);
+        if (file) {
+            fclose(file);
+        }
+        file = fopen(path.c_str(), "wb");
+        failed = !file || !syncToDisk(file);
+        return !failed;
+    }
+
+    // Read a log from the start and pass each intact record to `apply`.
+    // Stops at the first short or corrupt record (a write torn by a crash);
+    // `torn` tells whether anything was left over after the last good record.
+    template <typename Apply>
+    static size_t replay(const string& logPath, Apply apply, bool& torn) {
+        torn = false;
+        ifstream in(logPath, ios::binary | ios::ate);
+        uint64_t size = in ? static_cast<uint64_t>(in.tellg()) : 0;
+        in.seekg(0);
+        size_t applied = 0;
+        uint32_t length;
+        uint64_t checksum;
+        string payload;
+        JournalRecord record;
+        while (readBinary(in, length)) {
+            if (length > size - static_cast<uint64_t>(in.tellg())) {
+                torn = true; // A damaged length; reading it would allocate up to 4 GB
+                break;
+            }
+            payload.resize(length);
+            if (!readBinary(in, checksum) || !in.read(&payload[0], length) ||
+                hashBytes(payload.data(), payload.size()) != checksum || !decode(payload, record)) {
+                torn = true;
+                break;
+            }
+            apply(record);
+            applied++;
+        }
+        if (!torn && in.gcount() != 0) {
+            torn = true; // Part of a length field
+        }
+        return applied;
+    }
+
+    void displayStats() {
+        lock_guard<mutex> lock(logMutex);
+        cout << CYAN << "Write-Ahead Log: " << appendCount << " record(s) appended, " << flushCount << " group commit(s)"
+             << " (" << (flushCount ? static_cast<double>(appendCount) / flushCount : 0.0) << " records per fsync), "
+             << bytesWritten << " bytes written, last LSN " << lastLsn << (failed ? " -- WRITE FAILED" : "") << RESET << endl;
+    }
+};
+
+// Main File System class
+class FileSystem
+{
+public:
+    FolderNode* root;       // Root directory
+    FolderNode* current;    // Current working directory
+    HashTable metadata;     // Stores file metadata
+    RecycleBin bin;         // Recycle bin for deleted files
+    FileQueue* recent;      // Recent files of the current session (nullptr when logged out)
+    int recentCapacity;     // Capacity of the recent files list for new sessions
+    UserAuth auth;          // User authentication system
+    UserGraph userGraph;    // User graph for file sharing
+    DentryCache dentries;   // Absolute folder path -> folder lookup cache
+    ContentCache contentCache; // File identity -> latest content, for reads
+    FilePriorityHeap fileHeap; // Heap for managing file priorities
+    string loggedInUser;    // Currently logged in user
+    Role loggedInUserRole;  // Role of the currently logged in user
+    UserNode* currentUser;  // Account of the currently logged in user (nullptr when logged out)
+    Symbol loggedInUserSymbol; // Interned name of the currently logged in user
+    WriteAheadLog* wal;     // Log of every change since the last checkpoint (nullptr when not persisted)
+    MappedImage* image;     // Latest checkpoint, mapped read-only (nullptr if there is none)
+    string imagePath;
+    bool replaying;         // Set while the log is replayed, so replayed changes are not logged again
+    uint64_t checkpointInterval; // Logged changes between automatic checkpoints
+    uint64_t sinceCheckpoint;    // Changes logged since the last checkpoint
+    size_t replayFailures;       // Logged changes that failed on replay; checkpoints are refused while non-zero
+    bool plaintextRecovered;     // The image or log held credentials from before they were hashed
+
+    // Constructor to initialize file system
+    FileSystem()
+    {
+        root = folderPool.create("root", nullptr, nullptr, nullptr, nullptr);
+        root->id = ++lastFolderId;
+        current = root;
+        loggedInUser = "";
+        loggedInUserRole = Role::None;
+        currentUser = nullptr;
+        loggedInUserSymbol = NO_SYMBOL;
+        recent = nullptr;
+        recentCapacity = 256;
+        wal = nullptr;
+        image = nullptr;
+        replaying = false;
+        replayFailures = 0;
+        plaintextRecovered = false;
+        checkpointInterval = 100000;
+        sinceCheckpoint = 0;
+        UserNode* admin = auth.signup("admin", "admin123", "admin", "secret"); // Default admin user
+        userGraph.addUser(admin->id, "admin"); // Add admin to graph
+    }
+
+    // Destructor to clean up the entire file system hierarchy
+    ~FileSystem() {
+        delete wal; // Flushes the last group commit
+        delete recent;
+        blobStore.detach(); // Before the files let go of their chunks
+        destroyFolderTree(root); // Iteratively frees every folder, file and version
+        bin.useImage(nullptr, {}); // The reaper may still run until the bin is destroyed
+        delete image;
+    }
+
+    // Start a session for a user who has logged in, with an empty recent files list
+    void beginSession(UserNode* user) {
+        delete recent;
+        currentUser = user;
+        loggedInUser = symbols.str(user->username);
+        loggedInUserSymbol = user->username;
+        loggedInUserRole = user->role;
+        recent = new FileQueue(recentCapacity);
+    }
+
+    // End the current session and drop its recent files list
+    void endSession() {
+        logout();
+        currentUser = nullptr;
+        loggedInUserSymbol = NO_SYMBOL;
+        loggedInUser = "";
+        loggedInUserRole = Role::None;
+        delete recent;
+        recent = nullptr;
+    }
+
+    // Act as a user without starting a session (log replay)
+    void actAs(UserNode* user) {
+        currentUser = user;
+        loggedInUser = user ? symbols.str(user->username) : "";
+        loggedInUserSymbol = user ? user->username : NO_SYMBOL;
+        loggedInUserRole = user ? user->role : Role::None;
+    }
+
+    // Record a completed change in the write-ahead log, checkpointing every checkpointInterval changes
+    void journal(JournalOp op, vector<string> args, int64_t number = 0) {
+        if (!wal || replaying) {
+            return;
+        }
+        JournalRecord record;
+        record.op = op;
+        record.time = currentTime();
+        record.actor = loggedInUser;
+        record.args = move(args);
+        record.number = number;
+        if (wal->append(move(record)) == 0) {
+            cout << RED << "The write-ahead log cannot be written; this change will be lost on restart." << RESET << endl;
+            return;
+        }
+        if (++sinceCheckpoint >= checkpointInterval && replayFailures == 0) {
+            checkpoint();
+        }
+    }
+
+    // Register a user and add them to the sharing graph. The log gets the
+    // credential hashes, never the password or the security answer.
+    bool signup(string username, string password, string role, string secAns) {
+        UserNode* user = auth.signup(username, password, role, secAns);
+        if (!user) {
+            return false;
+        }
+        userGraph.addUser(user->id, username); // Add user to the graph for sharing
+        journal(JournalOp::Signup, { username, role, user->salt, user->passwordHash, user->answerHash });
+        return true;
+    }
+
+    // Replay a logged signup with the credential hashes it was logged with
+    bool restoreSignup(const string& username, const string& role, const string& salt,
+                       const string& passwordHash, const string& answerHash) {
+        Role parsedRole = parseRole(role);
+        if (auth.find(username) || parsedRole == Role::None) {
+            return false;
+        }
+        UserNode* user = auth.addAccount(username, parsedRole, salt, passwordHash, answerHash);
+        userGraph.addUser(user->id, username);
+        return true;
+    }
+
+    // Record the logout time of the current user
+    bool logout() {
+        if (!currentUser) {
+            return false;
+        }
+        auth.logout(currentUser);
+        journal(JournalOp::Logout, {});
+        return true;
+    }
+
+    // Set a new password for a user who answered their security question
+    bool resetPassword(const string& username, const string& password, const string& secAns) {
+        UserNode* user = auth.find(username);
+        if (!user) {
+            return false;
+        }
+        auth.setPassword(user, password, secAns);
+        journal(JournalOp::ResetPassword, { username, user->salt, user->passwordHash, user->answerHash });
+        return true;
+    }
+
+    // Replay a logged password reset with the hashes it was logged with
+    bool restorePassword(const string& username, const string& salt, const string& passwordHash, const string& answerHash) {
+        UserNode* user = auth.find(username);
+        if (!user) {
+            return false;
+        }
+        user->salt = salt;
+        user->passwordHash = passwordHash;
+        user->answerHash = answerHash;
+        return true;
+    }
+
+    // Change how many recent files are kept, for this session and later ones
+    void setRecentCapacity(int capacity) {
+        recentCapacity = max(capacity, 0);
+        if (recent) {
+            recent->setCapacity(recentCapacity);
+        }
+        cout << GREEN << "Recent Files now keep up to " << recentCapacity << " file(s)." << RESET << endl;
+    }
+
+    // Check the logged in user's permissions on a file: owner and role first,
+    // then the shares recorded for the file in the user graph
+    bool canAccess(FileNode* file, PermissionMask required) {
+        if (file->canAccess(loggedInUserSymbol, loggedInUserRole, required)) {
+            return true;
+        }
+        vector<uint64_t> keys = { file->id };
+        for (FolderNode* folder = file->folder; folder; folder = folder->parent) {
+            keys.push_back(folder->id | FOLDER_KEY_FLAG); // Folder shares are inherited
+        }
+        PermissionMask shared = currentUser ? userGraph.sharedPermissions(keys, currentUser->id) : 0;
+        return file->canAccess(loggedInUserSymbol, loggedInUserRole, required, shared);
+    }
+
+    // canAccess() for a file that is still only a record in the image, given
+    // the share keys of the folders above it
+    bool canAccessRecord(const FileRecordSummary& summary, const vector<uint64_t>& folderKeys, PermissionMask required) {
+        if (loggedInUserSymbol != NO_SYMBOL && symbols.find(summary.owner) == loggedInUserSymbol) {
+            return true; // Owners may do anything
+        }
+        PermissionMask granted = ROLE_PERMISSIONS[static_cast<int>(loggedInUserRole)];
+        if ((granted & required) != required && currentUser) {
+            vector<uint64_t> keys{ summary.id };
+            keys.insert(keys.end(), folderKeys.begin(), folderKeys.end());
+            granted |= userGraph.sharedPermissions(keys, currentUser->id);
+        }
+        return (granted & required) == required;
+    }
+
+    // Check the logged in user's permissions on a folder: role, then shares of it or a folder above it
+    bool canAccessFolder(FolderNode* folder, PermissionMask required) {
+        PermissionMask granted = ROLE_PERMISSIONS[static_cast<int>(loggedInUserRole)];
+        if ((granted & required) != required && currentUser) {
+            vector<uint64_t> keys;
+            for (; folder; folder = folder->parent) {
+                keys.push_back(folder->id | FOLDER_KEY_FLAG);
+            }
+            granted |= userGraph.sharedPermissions(keys, currentUser->id);
+        }
+        return (granted & required) == required;
+    }
+
+    // Graph ID of a share receiver: a username, or "@name" for a group (0 if not found)
+    uint32_t findPrincipal(const string& receiver) {
+        if (!receiver.empty() && receiver[0] == '@') {
+            return userGraph.findGroup(receiver.substr(1));
+        }
+        UserNode* user = auth.find(receiver);
+        return user ? user->id : 0;
+    }
+
+    // Mark a file as recently accessed in the current session
+    void markRecent(FileNode* file) {
+        if (recent) {
+            recent->enqueue(file->id, getFilePath(file));
+        }
+    }
+
+    // Absolute path of a folder, e.g. /root/docs/reports
+    string getFolderPath(FolderNode* folder)
+    {
+        string path = "";
+        while (folder)
+        {
+            path = "/" + folder->name + path;
+            folder = folder->parent;
+        }
+        return path;
+    }
+
+    // Absolute path of a file, used as its metadata key
+    string getFilePath(FileNode* file)
+    {
+        return getFolderPath(file->folder) + "/" + symbols.str(file->name);
+    }
+
+    // Visit every file in a folder subtree (iteratively). Folders not yet
+    // loaded from the image are skipped: none of their files are indexed.
+    template <typename Visit>
+    void forEachFile(FolderNode* folder, Visit visit)
+    {
+        vector<FolderNode*> pending{ folder };
+        while (!pending.empty()) {
+            FolderNode* curr = pending.back();
+            pending.pop_back();
+            for (FolderNode* sub = curr->child; sub; sub = sub->sibling) {
+                pending.push_back(sub);
+            }
+            for (FileNode* file = curr->files; file; file = file->next) {
+                visit(file);
+            }
+        }
+    }
+
+    // Refresh size and modification time after a file's content changed
+    void touchMetadata(FileNode* file)
+    {
+        file->modified = currentTime();
+        metadata.touch(getFilePath(file), static_cast<int>(file->versions.latestContent.size()), file->modified);
+    }
+
+    // Re-key the metadata of every file below a folder whose path changed
+    void rekeyMetadata(FolderNode* folder, const string& oldPath)
+    {
+        string newPath = getFolderPath(folder);
+        forEachFile(folder, [&](FileNode* file) {
+            string path = getFilePath(file);
+            metadata.rekey(oldPath + path.substr(newPath.length()), path);
+        });
+    }
+
+    // Canonical absolute form of a path: /root followed by the components, with
+    // . and .. applied. Relative paths are taken from the current folder.
+    string canonicalPath(const string& path)
+    {
+        vector<string> parts = splitPath(path);
+        if (path.empty() || path[0] != '/') {
+            vector<string> base = splitPath(getFolderPath(current));
+            parts.insert(parts.begin(), base.begin(), base.end());
+        }
+        vector<string> canonical;
+        for (size_t i = 0; i < parts.size(); i++) {
+            if (i == 0 && parts[i] == root->name) continue;
+            if (parts[i] == ".") continue;
+            if (parts[i] == "..") {
+                if (!canonical.empty()) canonical.pop_back();
+                continue;
+            }
+            canonical.push_back(parts[i]);
+        }
+        string key = "/" + root->name;
+        for (const string& part : canonical) {
+            key += "/" + part;
+        }
+        return key;
+    }
+
+    // Resolve a folder path. Absolute paths ("/root/a/b" or "/a/b") go through the
+    // dentry cache; relative paths ("a/b", "../c") are walked from the current folder.
+    FolderNode* resolveFolder(const string& path)
+    {
+        vector<string> parts = splitPath(path);
+        if (path.empty() || path[0] != '/') {
+            FolderNode* folder = current;
+            for (const string& part : parts) {
+                if (part == ".") continue;
+                folder = (part == "..") ? (folder->parent ? folder->parent : folder) : folder->findChild(part);
+                if (!folder) return nullptr;
+            }
+            return folder;
+        }
+
+        string key = canonicalPath(path);
+        FolderNode* folder = dentries.lookup(key);
+        if (folder) {
+            return folder;
+        }
+        vector<string> canonical = splitPath(key);
+        folder = root;
+        for (size_t i = 1; i < canonical.size(); i++) { // canonical[0] is the root itself
+            folder = folder->findChild(canonical[i]);
+            if (!folder) return nullptr;
+        }
+        dentries.insert(key, folder);
+        return folder;
+    }
+
+    // Result of resolving a path: the containing folder and what the last component names
+    struct ResolvedPath {
+        FolderNode* parent; // Folder holding the last component (nullptr if it does not exist)
+        string name;        // Last path component
+        FileNode* file;     // File with that name, if any
+        FolderNode* folder; // Folder with that name, if any
+    };
+
+    // Resolve a file or folder path such as "/root/a/b/c/file.txt", "a/file.txt" or "file.txt"
+    ResolvedPath resolve(const string& path)
+    {
+        ResolvedPath result{ nullptr, "", nullptr, nullptr };
+        string trimmed = path;
+        while (trimmed.length() > 1 && trimmed.back() == '/') trimmed.pop_back();
+
+        size_t slash = trimmed.rfind('/');
+        result.name = (slash == string::npos) ? trimmed : trimmed.substr(slash + 1);
+        if (result.name.empty() || result.name == "." || result.name == ".." ||
+            (slash == 0 && result.name == root->name)) {
+            result.folder = resolveFolder(trimmed); // Names a folder only
+            result.parent = result.folder ? result.folder->parent : nullptr;
+            return result;
+        }
+
+        if (slash == string::npos) {
+            result.parent = current;
+        } else {
+            result.parent = resolveFolder(slash == 0 ? "/" : trimmed.substr(0, slash));
+        }
+        if (result.parent) {
+            result.file = result.parent->findFile(result.name);
+            result.folder = result.parent->findChild(result.name);
+        }
+        return result;
+    }
+
+    // Create a new folder in current directory (or at the given path)
+    bool createFolder(string name)
+    {
+        ResolvedPath target = resolve(name);
+        if (!target.parent || target.name.empty() || target.name == "." || target.name == "..") {
+            cout << RED << "Cannot create folder '" << name << "': parent folder not found." << RESET << endl;
+            return false;
+        }
+
+        // Check for duplication
+        if (target.folder) {
+            cout << RED << "Folder '" << target.name << "' already exists in this directory." << RESET << endl;
+            return false;
+        }
+
+        FolderNode* newFolder = folderPool.create(target.name, target.parent, nullptr, nullptr, nullptr);
+        newFolder->id = ++lastFolderId;
+        target.parent->addChild(newFolder);
+        cout << GREEN << "Folder created: " << target.name << RESET << endl;
+        journal(JournalOp::CreateFolder, { getFolderPath(newFolder) });
+        return true;
+    }
+
+    // Create a new file with initial content
+    bool createFile(string name, string type, string content, int priority = 0)
+    {
+        // Permission check for creating files
+        if (loggedInUserRole != Role::Admin && loggedInUserRole != Role::Editor) {
+             cout << RED << "Permission denied. Only admins and editors can create files." << RESET << endl;
+             return false;
+        }
+
+        FolderNode* targetFolder = current;
+        size_t slash = name.rfind('/');
+        if (slash != string::npos) { // Path given, create the file in that folder
+            targetFolder = resolveFolder(slash == 0 ? "/" : name.substr(0, slash));
+            name = name.substr(slash + 1);
+            if (!targetFolder || name.empty()) {
+                cout << RED << "Cannot create file: target folder not found or file name missing." << RESET << endl;
+                return false;
+            }
+        } else if (current->ensureLoaded(), current->child) {
+            cout << "Available subfolders in current directory:" << endl;
+            FolderNode* temp = current->child;
+            int i = 1;
+            while (temp) {
+                cout << i << ". " << temp->name << endl;
+                i++;
+                temp = temp->sibling;
+            }
+            cout << "Enter subfolder name to create the file in, or type 'current' to use current directory: ";
+            string folderNameChoice;
+            getline(cin, folderNameChoice);
+
+            if (!folderNameChoice.empty() && folderNameChoice != "current") {
+                temp = current->findChild(folderNameChoice);
+                if (temp) {
+                    targetFolder = temp;
+                } else {
+                    cout << YELLOW << "Subfolder '" << folderNameChoice << "' not found. File will be created in the current directory." << RESET << endl;
+                }
+            }
+        }
+
+        // Check if file with same name already exists in target folder
+        FileNode* existingFile = targetFolder->findFile(name);
+        if (existingFile) {
+            cout << YELLOW << "File '" << name << "' already exists. Adding a new version instead." << RESET << endl;
+            // Add new version to existing file
+            existingFile->versions.append(content);
+            contentCache.invalidate(existingFile->id);
+            touchMetadata(existingFile);
+            cout << GREEN << "New version added for file '" << name << "'." << RESET << endl;
+            markRecent(existingFile); // Mark as recently accessed
+            journal(JournalOp::CreateFileChunks, { getFilePath(existingFile), type, existingFile->versions.latestContent.references() }, priority);
+            return true; // Exit as new version added
+        }
+
+        // If file does not exist, create new file and its first version
+        FileNode* newFile = fileNodePool.create(symbols.intern(name), symbols.intern(type), loggedInUserSymbol);
+        newFile->id = ++lastFileId;
+        newFile->priority = priority;
+        newFile->versions.append(content);
+        targetFolder->addFile(newFile);
+
+        newFile->created = newFile->modified = newFile->versions.tail->created;
+        metadata.insert(getFilePath(newFile), newFile->type, content.length(), newFile->owner, newFile->created);
+        markRecent(newFile);
+        fileHeap.insert(newFile);
+        cout << GREEN << "File added to priority heap." << RESET << endl;
+        cout << GREEN << "File created: " << name << " in folder " << targetFolder->name << RESET << endl;
+        journal(JournalOp::CreateFileChunks, { getFilePath(newFile), type, newFile->versions.latestContent.references() }, priority);
+        return true;
+    }
+
+    // List all folders in current directory
+    void listFolders()
+    {
+        current->ensureLoaded();
+        FolderNode* temp = current->child;
+        if (!temp)
+        {
+            cout << RED << "No subfolders in current directory." << RESET << endl;
+        }
+        else
+        {
+            cout << CYAN << "Subfolders in '" << current->name << "':" << RESET << endl;
+            while (temp)
+            {
+                cout << YELLOW << temp->name << RESET << endl;
+                temp = temp->sibling;
+            }
+        }
+    }
+
+    // List all files in current directory
+    void listFiles()
+    {
+        current->ensureLoaded();
+        FileNode* temp = current->files;
+        if (!temp)
+        {
+            cout << RED << "No files in current directory." << RESET << endl;
+        }
+        else
+        {
+            cout << CYAN << "Files in '" << current->name << "':" << RESET << endl;
+            while (temp)
+            {
+                cout << YELLOW << symbols.str(temp->name) << " (" << symbols.str(temp->type) << ", Owner: " << symbols.str(temp->owner) << ")" << RESET << endl;
+                temp = temp->next;
+            }
+        }
+    }
+
+    // Find a file node by name in the current directory, or by path
+    FileNode* findFileInCurrentDirectory(string name) {
+        return resolve(name).file;
+    }
+
+    // Display latest content of a file
+    void readFile(string name)
+    {
+        FileNode* file = findFileInCurrentDirectory(name);
+        if (!file)
+        {
+            cout << RED << "File '" << name << "' not found." << RESET << endl;
+            return;
+        }
+
+        // Access control check
+        if (!canAccess(file, PERM_READ)) { // Check if user has read permission
+            cout << RED << "Permission denied to read file '" << name << "'." << RESET << endl;
+            return;
+        }
+
+        const Blob& latest = file->versions.latestContent;
+        if (latest.size() >= STREAMED_READ_MIN_BYTES) {
+            // Large files go from their content segments straight to the
+            // terminal; they are never assembled in memory or cached
+            cout << GREEN << "Latest Content of '" << name << "': " << flush;
+            fflush(stdout);
+            if (!latest.writeTo(fileno(stdout))) {
+                cout << RED << " (read failed)";
+            }
+            cout << RESET << endl;
+        } else if (const string* cached = contentCache.lookup(file->id)) {
+            cout << GREEN << "Latest Content of '" << name << "': " << *cached << RESET << endl;
+        } else {
+            string content = file->versions.latestContent.str();
+            cout << GREEN << "Latest Content of '" << name << "': " << content << RESET << endl;
+            contentCache.insert(file->id, move(content));
+        }
+        markRecent(file); // Mark as recently accessed
+    }
+
+    // Add new version to a file
+    bool updateFile(string name, string newContent)
+    {
+        FileNode* file = findFileInCurrentDirectory(name);
+        if (!file)
+        {
+            cout << RED << "File '" << name << "' not found." << RESET << endl;
+            return false;
+        }
+
+        // Access control check
+        if (!canAccess(file, PERM_WRITE)) {
+            cout << RED << "Permission denied to write to file '" << name << "'." << RESET << endl;
+            return false;
+        }
+
+        file->versions.append(newContent);
+        contentCache.invalidate(file->id);
+        touchMetadata(file);
+        cout << GREEN << "File '" << name << "' updated with new version." << RESET << endl;
+        markRecent(file); // Mark as recently accessed
+        journal(JournalOp::UpdateFileChunks, { getFilePath(file), file->versions.latestContent.references() });
+        return true;
+    }
+
+    // Revert to previous version of a file
+    bool rollbackFile(string name)
+    {
+        FileNode* file = findFileInCurrentDirectory(name);
+        if (!file) {
+            cout << RED << "File '" << name << "' not found." << RESET << endl;
+            return false;
+        }
+
+        // Access control check
+        if (!canAccess(file, PERM_WRITE)) { // Rollback is a write operation
+            cout << RED << "Permission denied to rollback file '" << name << "'." << RESET << endl;
+            return false;
+        }
+
+        if (!file->versions.truncateTo(file->versions.count() - 1)) // Only one version exists
+        {
+            cout << RED << "No older version to rollback for file '" << name << "'." << RESET << endl;
+            return false;
+        }
+
+        contentCache.invalidate(file->id);
+        touchMetadata(file);
+        cout << GREEN << "File '" << name << "' rolled back to previous version." << RESET << endl;
+        markRecent(file); // Mark as recently accessed
+        journal(JournalOp::RollbackFile, { getFilePath(file) });
+        return true;
+    }
+
+    // Display the content of a specific version of a file
+    void readFileVersion(string name, int k)
+    {
+        FileNode* file = findFileInCurrentDirectory(name);
+        if (!file)
+        {
+            cout << RED << "File '" << name << "' not found." << RESET << endl;
+            return;
+        }
+
+        // Access control check
+        if (!canAccess(file, PERM_READ)) {
+            cout << RED << "Permission denied to read file '" << name << "'." << RESET << endl;
+            return;
+        }
+
+        FileVersion* ver = file->versions.at(k);
+        if (!ver) {
+            cout << RED << "File '" << name << "' has no version " << k << " (versions 1-" << file->versions.count() << ")." << RESET << endl;
+            return;
+        }
+        cout << GREEN << "Content of '" << name << "' at version " << k << " (saved " << formatTime(ver->created) << "): "
+             << file->versions.materialize(ver) << RESET << endl;
+        markRecent(file); // Mark as recently accessed
+    }
+
+    // Revert a file to a specific version, discarding every newer version
+    bool rollbackFileToVersion(string name, int k)
+    {
+        FileNode* file = findFileInCurrentDirectory(name);
+        if (!file) {
+            cout << RED << "File '" << name << "' not found." << RESET << endl;
+            return false;
+        }
+
+        // Access control check
+        if (!canAccess(file, PERM_WRITE)) { // Rollback is a write operation
+            cout << RED << "Permission denied to rollback file '" << name << "'." << RESET << endl;
+            return false;
+        }
+
+        if (k == file->versions.count()) {
+            cout << YELLOW << "Version " << k << " is already the latest version of '" << name << "'." << RESET << endl;
+            return false;
+        }
+        if (!file->versions.truncateTo(k)) {
+            cout << RED << "File '" << name << "' has no version " << k << " (versions 1-" << file->versions.count() << ")." << RESET << endl;
+            return false;
+        }
+
+        contentCache.invalidate(file->id);
+        touchMetadata(file);
+        cout << GREEN << "File '" << name << "' rolled back to version " << k << "." << RESET << endl;
+        markRecent(file); // Mark as recently accessed
+        journal(JournalOp::RollbackFileToVersion, { getFilePath(file) }, k);
+        return true;
+    }
+
+    // Change current working directory (folder name, relative or absolute path)
+    void changeDirectory(string name)
+    {
+        if (name == ".." && current->parent)
+        {
+            current = current->parent;
+            cout << GREEN << "Changed directory to parent." << RESET << endl;
+            return;
+        }
+        if (name == "root") { // Special case to go to root
+            current = root;
+            cout << GREEN << "Changed directory to root." << RESET << endl;
+            return;
+        }
+
+        FolderNode* temp = resolveFolder(name);
+        if (temp)
+        {
+            current = temp;
+            cout << GREEN << "Changed directory to: " << name << RESET << endl;
+            return;
+        }
+        cout << RED << "Folder '" << name << "' not found." << RESET << endl;
+    }
+
+    // Delete a file (moves to recycle bin)
+    bool deleteFile(string name)
+    {
+        FileNode* curr = findFileInCurrentDirectory(name);
+        if (!curr)
+        {
+            cout << RED << "File '" << name << "' not found." << RESET << endl;
+            return false;
+        }
+
+        // Access control check
+        if (!canAccess(curr, PERM_WRITE)) { // Deletion is a write operation
+            cout << RED << "Permission denied to delete file '" << name << "'." << RESET << endl;
+            return false;
+        }
+
+        // Detach the file from its folder and move it, with its versions, to the recycle bin
+        string path = getFilePath(curr);
+        metadata.remove(path); // Also remove from metadata hash table
+        curr->folder->removeFile(curr);
+        contentCache.invalidate(curr->id);
+        if (recent) {
+            recent->forget(curr->id);
+        }
+        fileHeap.remove(curr); // The heap must not keep a file that may be spilled or purged
+        bin.push(curr, path);
+        cout << GREEN << "File '" << name << "' successfully deleted and moved to Recycle Bin." << RESET << endl;
+        journal(JournalOp::DeleteFile, { path });
+        return true;
+    }
+
+    // Restore a file from the recycle bin to the folder it was deleted from.
+    // Accepts a file name, an original path, or "" for the last deleted file.
+    bool restoreFile(string name)
+    {
+        string key = name.find('/') != string::npos ? canonicalPath(name) : name;
+        DeletedFile* entry = bin.take(key);
+        if (!entry) {
+            cout << RED << (name.empty() ? "Recycle Bin is empty. Nothing to restore." : "No deleted file matches '" + name + "'.") << RESET << endl;
+            return false;
+        }
+
+        // Original folder, or root if it no longer exists
+        string path = entry->originalPath;
+        FolderNode* target = resolveFolder(path.substr(0, path.rfind('/')));
+        if (!target) {
+            target = root;
+            cout << YELLOW << "Original folder of '" << path << "' no longer exists. Restoring to " << getFolderPath(root) << "." << RESET << endl;
+        }
+        if (target->findFile(entry->name)) {
+            cout << RED << "A file named '" << symbols.str(entry->name) << "' already exists in " << getFolderPath(target)
+                 << ". Rename or delete it first." << RESET << endl;
+            bin.putBack(entry);
+            return false;
+        }
+
+        // Move the FileNode (with its version chain) back into the tree
+        FileNode* file = entry->file;
+        bin.release(entry);
+        target->addFile(file);
+        fileHeap.insert(file);
+        metadata.insert(getFilePath(file), file->type, static_cast<int>(file->versions.latestContent.size()), file->owner, file->created, file->modified);
+        markRecent(file);
+        cout << GREEN << "File '" << symbols.str(file->name) << "' restored to " << getFilePath(file) << " with "
+             << file->versions.count() << " version(s)." << RESET << endl;
+        journal(JournalOp::RestoreFile, { path }); // Replay takes the newest entry for the original path, which is this one
+        return true;
+    }
+
+    // Delete a folder (and its contents), after asking the user to confirm
+    bool deleteFolder(string name, bool confirm = true) {
+        if (loggedInUserRole != Role::Admin) {
+            cout << RED << "Permission denied. Only admins can delete folders." << RESET << endl;
+            return false;
+        }
+
+        if (name == ".." || name == "root") {
+            cout << RED << "Cannot delete special folders like '..' or 'root'." << RESET << endl;
+            return false;
+        }
+
+        FolderNode* curr = resolve(name).folder;
+        if (!curr) {
+            cout << RED << "Folder '" << name << "' not found." << RESET << endl;
+            return false;
+        }
+        if (curr == root) {
+            cout << RED << "Cannot delete special folders like '..' or 'root'." << RESET << endl;
+            return false;
+        }
+
+        // Confirm deletion for safety
+        if (confirm) {
+            cout << YELLOW << "WARNING: Deleting folder '" << name << "' will permanently delete all its contents. Are you sure? (yes/no): " << RESET;
+            string confirmation;
+            getline(cin, confirmation);
+            if (confirmation != "yes") {
+                cout << BLUE << "Folder deletion cancelled." << RESET << endl;
+                return false;
+            }
+        }
+
+        // Leave the subtree first if the current directory is inside it
+        for (FolderNode* temp = current; temp; temp = temp->parent) {
+            if (temp == curr) {
+                current = curr->parent;
+                break;
+            }
+        }
+        string path = getFolderPath(curr);
+        dentries.invalidatePrefix(path);
+        releaseUnloadedFiles(curr); // Files still only in the image hold chunk references to give up
+        forEachFile(curr, [&](FileNode* file) {
+            metadata.remove(getFilePath(file));
+            contentCache.invalidate(file->id);
+            if (recent) {
+                recent->forget(file->id);
+            }
+            fileHeap.remove(file);
+        });
+        curr->parent->removeChild(curr);
+        destroyFolderTree(curr); // Frees all contained files and subfolders in one pass
+        cout << GREEN << "Folder '" << name << "' and its contents permanently deleted." << RESET << endl;
+        journal(JournalOp::DeleteFolder, { path });
+        return true;
+    }
+
+
+    // Rename a folder in place
+    bool renameFolder(string path, string newName)
+    {
+        if (loggedInUserRole != Role::Admin && loggedInUserRole != Role::Editor) {
+            cout << RED << "Permission denied. Only admins and editors can rename folders." << RESET << endl;
+            return false;
+        }
+        FolderNode* folder = resolve(path).folder;
+        if (!folder || folder == root) {
+            cout << RED << "Folder '" << path << "' not found or cannot be renamed." << RESET << endl;
+            return false;
+        }
+        if (newName.empty() || newName.find('/') != string::npos || newName == "." || newName == "..") {
+            cout << RED << "Invalid folder name '" << newName << "'." << RESET << endl;
+            return false;
+        }
+        if (folder->parent->findChild(newName)) {
+            cout << RED << "Folder '" << newName << "' already exists in this directory." << RESET << endl;
+            return false;
+        }
+
+        string oldPath = getFolderPath(folder);
+        dentries.invalidatePrefix(oldPath);
+        folder->parent->childIndex.erase(folder->name);
+        folder->name = newName;
+        folder->parent->childIndex[newName] = folder;
+        rekeyMetadata(folder, oldPath);
+        cout << GREEN << "Folder renamed to '" << newName << "'." << RESET << endl;
+        journal(JournalOp::RenameFolder, { oldPath, newName });
+        return true;
+    }
+
+    // Move a folder (with everything inside it) under another folder
+    bool moveFolder(string path, string destinationPath)
+    {
+        if (loggedInUserRole != Role::Admin && loggedInUserRole != Role::Editor) {
+            cout << RED << "Permission denied. Only admins and editors can move folders." << RESET << endl;
+            return false;
+        }
+        FolderNode* folder = resolve(path).folder;
+        FolderNode* destination = resolveFolder(destinationPath);
+        if (!folder || folder == root || !destination) {
+            cout << RED << "Folder '" << path << "' or destination '" << destinationPath << "' not found." << RESET << endl;
+            return false;
+        }
+        for (FolderNode* temp = destination; temp; temp = temp->parent) {
+            if (temp == folder) {
+                cout << RED << "Cannot move a folder into itself." << RESET << endl;
+                return false;
+            }
+        }
+        if (destination->findChild(folder->name)) {
+            cout << RED << "Folder '" << folder->name << "' already exists in the destination." << RESET << endl;
+            return false;
+        }
+
+        string oldPath = getFolderPath(folder);
+        dentries.invalidatePrefix(oldPath);
+        folder->parent->removeChild(folder);
+        destination->addChild(folder);
+        rekeyMetadata(folder, oldPath);
+        cout << GREEN << "Folder '" << folder->name << "' moved to " << getFolderPath(destination) << RESET << endl;
+        journal(JournalOp::MoveFolder, { oldPath, getFolderPath(destination) });
+        return true;
+    }
+
+    // Print current directory path
+    void printCurrentPath()
+    {
+        cout << BLUE << "Current Path: " << getFolderPath(current) << RESET << endl;
+    }
+
+    // Display file metadata
+    void viewMetadata(string name)
+    {
+        FileNode* file = findFileInCurrentDirectory(name);
+        fileData* meta = file ? metadata.search(getFilePath(file)) : nullptr;
+        if (!meta)
+        {
+            cout << RED << "Metadata not found for file '" << name << "'." << RESET << endl;
+        }
+        else
+        {
+            cout << CYAN << "Metadata for '" << name << "':" << RESET << endl;
+            cout << YELLOW << "Name: " << meta->name << "\nType: " << symbols.str(meta->type)
+                << "\nOwner: " << symbols.str(meta->owner) << "\nSize: " << meta->size << " bytes"
+                << "\nCreated: " << formatTime(meta->created)
+                << "\nModified: " << formatTime(meta->modified) << RESET << endl;
+        }
+    }
+
+    // Metadata of the files still only in the image, read from their records
+    deque<fileData> unloadedMetadata()
+    {
+        deque<fileData> records;
+        forEachUnloadedFile(root, [&](const string& path, const FileRecordSummary& summary, const vector<uint64_t>&) {
+            records.push_back({ path, symbols.intern(summary.type), symbols.intern(summary.owner), static_cast<int>(summary.size),
+                                summary.created, summary.modified });
+        });
+        return records;
+    }
+
+    // Find files whose metadata matches a query, e.g. "owner=alice AND type=.pdf AND size>1MB"
+    void queryMetadata(string expression)
+    {
+        deque<fileData> records = unloadedMetadata(); // The index only covers folders loaded from the image
+        vector<fileData*> unindexed;
+        for (fileData& data : records) {
+            unindexed.push_back(&data);
+        }
+        vector<fileData*> results;
+        if (!metadata.query(expression, results, unindexed)) {
+            return;
+        }
+        if (results.empty()) {
+            cout << YELLOW << "No files match the query." << RESET << endl;
+            return;
+        }
+        cout << CYAN << results.size() << " file(s) match:" << RESET << endl;
+        for (fileData* meta : results) {
+            cout << YELLOW << meta->name << " (" << symbols.str(meta->type) << ", Owner: " << symbols.str(meta->owner)
+                 << ", Size: " << meta->size << " bytes)" << RESET << endl;
+        }
+    }
+
+    // Capacity report computed from the columnar metadata store
+    void displayStorageReport()
+    {
+        deque<fileData> records = unloadedMetadata(); // Added to a copy of the columns, so nothing is loaded
+        MetadataColumns combined;
+        if (!records.empty()) {
+            combined = metadata.columns;
+            for (fileData& data : records) {
+                combined.add(&data);
+            }
+        }
+        const MetadataColumns& columns = records.empty() ? metadata.columns : combined;
+        if (columns.rows() == 0) {
+            cout << RED << "No files to report on." << RESET << endl;
+            return;
+        }
+        cout << CYAN << "Storage Report (" << columns.rows() << " files, " << columns.totalBytes() << " bytes, "
+             << columns.bytesModifiedSince(currentTime() - 24 * 60 * 60) << " bytes changed in the last day):" << RESET << endl;
+
+        cout << CYAN << "Bytes per owner:" << RESET << endl;
+        vector<long long> ownerBytes = columns.bytesPerOwner();
+        for (size_t id = 0; id < ownerBytes.size(); id++) {
+            if (ownerBytes[id] > 0) {
+                cout << YELLOW << "  " << symbols.str(columns.owners.values[id]) << ": " << ownerBytes[id] << " bytes" << RESET << endl;
+            }
+        }
+
+        cout << CYAN << "Files per type:" << RESET << endl;
+        vector<long long> typeCounts = columns.filesPerType();
+        for (size_t id = 0; id < typeCounts.size(); id++) {
+            if (typeCounts[id] > 0) {
+                cout << YELLOW << "  " << symbols.str(columns.types.values[id]) << ": " << typeCounts[id] << RESET << endl;
+            }
+        }
+
+        cout << CYAN << "Largest files:" << RESET << endl;
+        for (size_t row : columns.largestRows(10)) {
+            cout << YELLOW << "  " << columns.record[row]->name << " (" << columns.size[row] << " bytes)" << RESET << endl;
+        }
+    }
+
+    // Share a file with another user
+    bool shareFileWithUser(string receiver, string filename, string permission)
+    {
+        // Check if the file exists and loggedInUser is its owner or has execute access (for sharing)
+        FileNode* fileToShare = findFileInCurrentDirectory(filename);
+        if (!fileToShare) {
+            cout << RED << "File '" << filename << "' not found." << RESET << endl;
+            return false;
+        }
+        if (!canAccess(fileToShare, PERM_EXECUTE)) {
+            cout << RED << "Permission denied. You need execute access to share file '" << filename << "'." << RESET << endl;
+            return false;
+        }
+
+        uint32_t receiverId = findPrincipal(receiver);
+        if (!receiverId) {
+            cout << RED << "Receiver '" << receiver << "' not found." << RESET << endl;
+            return false;
+        }
+        if (userGraph.shareFile(currentUser->id, receiverId, fileToShare->id, getFilePath(fileToShare), permission)) {
+            journal(JournalOp::ShareFile, { receiver, getFilePath(fileToShare), permission });
+            return true;
+        }
+        return false;
+    }
+
+    // Share a folder, and so everything below it, with a user or group
+    bool shareFolderWithUser(string receiver, string folderPath, string permission)
+    {
+        FolderNode* folder = resolveFolder(folderPath);
+        if (!folder) {
+            cout << RED << "Folder '" << folderPath << "' not found." << RESET << endl;
+            return false;
+        }
+        if (!canAccessFolder(folder, PERM_EXECUTE)) {
+            cout << RED << "Permission denied. You need execute access to share folder '" << folderPath << "'." << RESET << endl;
+            return false;
+        }
+        uint32_t receiverId = findPrincipal(receiver);
+        if (!receiverId) {
+            cout << RED << "Receiver '" << receiver << "' not found." << RESET << endl;
+            return false;
+        }
+        if (userGraph.shareFile(currentUser->id, receiverId, folder->id | FOLDER_KEY_FLAG, getFolderPath(folder), permission)) {
+            journal(JournalOp::ShareFolder, { receiver, getFolderPath(folder), permission });
+            return true;
+        }
+        return false;
+    }
+
+    // Withdraw a share of a file or folder the logged-in user made
+    bool revokeShareFromUser(string receiver, string name)
+    {
+        ResolvedPath target = resolve(name);
+        uint64_t key;
+        string path;
+        if (target.file) {
+            key = target.file->id;
+            path = getFilePath(target.file);
+        } else if (target.folder) {
+            key = target.folder->id | FOLDER_KEY_FLAG;
+            path = getFolderPath(target.folder);
+        } else {
+            cout << RED << "File or folder '" << name << "' not found." << RESET << endl;
+            return false;
+        }
+        uint32_t receiverId = findPrincipal(receiver);
+        if (!receiverId || !userGraph.revokeShare(currentUser->id, receiverId, key)) {
+            cout << RED << "You have not shared '" << name << "' with '" << receiver << "'." << RESET << endl;
+            return false;
+        }
+        cout << GREEN << "Share of '" << path << "' with " << receiver << " revoked." << RESET << endl;
+        journal(JournalOp::RevokeShare, { receiver, path });
+        return true;
+    }
+
+    // Create a group owned by the logged-in user
+    bool createGroup(string name)
+    {
+        uint32_t groupId = userGraph.createGroup(currentUser->id, name);
+        if (groupId) {
+            userGraph.addMember(groupId, currentUser->id); // The creator starts as a member
+            journal(JournalOp::CreateGroup, { name });
+            return true;
+        }
+        return false;
+    }
+
+    // Add a user, or a group as "@name", to a group (group owner or admin only)
+    bool changeGroupMembership(string groupName, string member, bool add)
+    {
+        uint32_t groupId = userGraph.findGroup(groupName);
+        if (!groupId) {
+            cout << RED << "Group '" << groupName << "' not found." << RESET << endl;
+            return false;
+        }
+        if (userGraph.nodes[groupId]->ownerId != currentUser->id && loggedInUserRole != Role::Admin) {
+            cout << RED << "Permission denied. Only the group's owner or an admin can change its members." << RESET << endl;
+            return false;
+        }
+        uint32_t memberId = findPrincipal(member);
+        if (!memberId) {
+            cout << RED << "User or group '" << member << "' not found." << RESET << endl;
+            return false;
+        }
+        bool changed = add ? userGraph.addMember(groupId, memberId) : userGraph.removeMember(groupId, memberId);
+        if (changed) {
+            journal(add ? JournalOp::AddGroupMember : JournalOp::RemoveGroupMember, { groupName, member });
+            return true;
+        }
+        return false;
+    }
+
+    // Display files shared by the logged-in user
+    void displaySharedFilesByMe()
+    {
+        userGraph.displaySharedFiles(currentUser->id);
+    }
+
+    // Display files shared with the logged-in user
+    void displayFilesSharedWithMe() {
+        userGraph.displayFilesSharedWithMe(currentUser->id);
+    }
+
+
+    // Display content deduplication and metadata table statistics
+    void displayStorageStats()
+    {
+        uint64_t unloadedBytes = bin.imageContentBytes(); // Content of files still only in the image, read from their records
+        forEachUnloadedFile(root, [&](const string&, const FileRecordSummary& summary, const vector<uint64_t>&) {
+            unloadedBytes += summary.contentBytes;
+        });
+        blobStore.displayStats(unloadedBytes);
+        metadata.displayStats();
+        contentCache.displayStats();
+        if (wal) {
+            wal->displayStats();
+        }
+    }
+
+    // Display files by priority
+    void displayFilesByPriority()
+    {
+        vector<pair<int, string>> unloaded; // Files still only in the image, read from their records
+        forEachUnloadedFile(root, [&](const string&, const FileRecordSummary& summary, const vector<uint64_t>&) {
+            unloaded.emplace_back(summary.priority, summary.name);
+        });
+        fileHeap.display(move(unloaded));
+    }
+
+    // Show the k highest-priority files the user can read, optionally limited
+    // to a folder subtree and/or an owner ("" means no filter)
+    void displayTopFiles(int k, string folderPath, string ownerName)
+    {
+        FolderNode* within = nullptr;
+        if (!folderPath.empty()) {
+            within = resolveFolder(folderPath);
+            if (!within) {
+                cout << RED << "Folder '" << folderPath << "' not found." << RESET << endl;
+                return;
+            }
+        }
+        size_t limit = static_cast<size_t>(max(k, 0));
+
+        // Only loaded files are in the heap; the k best of the rest come from their records
+        struct Ranked {
+            int priority;
+            string path;
+            string owner;
+        };
+        vector<Ranked> unloaded;
+        forEachUnloadedFile(within ? within : root, [&](const string& path, const FileRecordSummary& summary, const vector<uint64_t>& folderKeys) {
+            if ((ownerName.empty() || summary.owner == ownerName) && canAccessRecord(summary, folderKeys, PERM_READ)) {
+                unloaded.push_back({ summary.priority, path, summary.owner });
+            }
+        });
+        auto higher = [](const Ranked& a, const Ranked& b) { return a.priority > b.priority; };
+        partial_sort(unloaded.begin(), unloaded.begin() + min(limit, unloaded.size()), unloaded.end(), higher);
+        unloaded.resize(min(limit, unloaded.size()));
+
+        Symbol owner = ownerName.empty() ? NO_SYMBOL : symbols.find(ownerName);
+        if (!ownerName.empty() && owner == NO_SYMBOL && unloaded.empty()) {
+            cout << RED << "No files owned by '" << ownerName << "'." << RESET << endl;
+            return;
+        }
+
+        vector<FileNode*> loaded = ownerName.empty() || owner != NO_SYMBOL ? fileHeap.topK(limit, [&](FileNode* file) {
+            if (owner != NO_SYMBOL && file->owner != owner) {
+                return false;
+            }
+            if (within) {
+                FolderNode* folder = file->folder;
+                while (folder && folder != within) {
+                    folder = folder->parent;
+                }
+                if (!folder) {
+                    return false;
+                }
+            }
+            return canAccess(file, PERM_READ);
+        }) : vector<FileNode*>();
+
+        vector<Ranked> top;
+        for (FileNode* file : loaded) {
+            top.push_back({ file->priority, getFilePath(file), symbols.str(file->owner) });
+        }
+        vector<Ranked> merged(top.size() + unloaded.size());
+        merge(top.begin(), top.end(), unloaded.begin(), unloaded.end(), merged.begin(), higher);
+        merged.resize(min(limit, merged.size()));
+        if (merged.empty()) {
+            cout << RED << "No matching files." << RESET << endl;
+            return;
+        }
+        cout << CYAN << "Top " << merged.size() << " File(s) by Priority:" << RESET << endl;
+        for (size_t i = 0; i < merged.size(); i++) {
+            cout << YELLOW << (i + 1) << ". " << merged[i].path << " (Priority: " << merged[i].priority
+                 << ", Owner: " << merged[i].owner << ")" << RESET << endl;
+        }
+    }
+
+    // Change the priority of a file in place; the heap re-sorts it in O(log n)
+    bool setFilePriority(string name, int priority)
+    {
+        FileNode* file = findFileInCurrentDirectory(name);
+        if (!file)
+        {
+            cout << RED << "File '" << name << "' not found." << RESET << endl;
+            return false;
+        }
+        if (!canAccess(file, PERM_WRITE)) {
+            cout << RED << "Permission denied to change the priority of file '" << name << "'." << RESET << endl;
+            return false;
+        }
+        int previous = file->priority;
+        fileHeap.updatePriority(file, priority);
+        cout << GREEN << "Priority of '" << symbols.str(file->name) << "' changed from " << previous << " to " << priority << "." << RESET << endl;
+        journal(JournalOp::SetPriority, { getFilePath(file) }, priority);
+        return true;
+    }
+
+    // Change how long the recycle bin keeps deleted files
+    bool setRetention(Timestamp seconds)
+    {
+        bin.setRetention(seconds);
+        journal(JournalOp::SetRetention, {}, seconds);
+        return true;
+    }
+
+    // Write everything that is not part of the folder tree: accounts, groups,
+    // memberships, shares and the recycle bin (groups before their members).
+    // `relocated` is filled as for RecycleBin::save().
+    void writeTail(ostream& out, vector<pair<DeletedFile*, uint64_t>>& relocated)
+    {
+        // Accounts, oldest first
+        vector<UserNode*> users;
+        for (UserNode* user = auth.head; user; user = user->next) {
+            users.push_back(user);
+        }
+        writeBinary<uint64_t>(out, users.size());
+        for (auto it = users.rbegin(); it != users.rend(); ++it) {
+            UserNode* user = *it;
+            writeBinary<uint32_t>(out, user->id);
+            writeBinaryString(out, symbols.str(user->username));
+            writeBinaryString(out, user->salt);
+            writeBinaryString(out, user->passwordHash);
+            writeBinary<uint8_t>(out, static_cast<uint8_t>(user->role));
+            writeBinaryString(out, user->answerHash);
+            writeBinary<Timestamp>(out, user->lastLogout);
+        }
+
+        // Groups, then memberships, then shares
+        writeBinary<uint64_t>(out, userGraph.groupIds.size());
+        for (const auto& group : userGraph.groupIds) {
+            writeBinary<uint32_t>(out, group.second);
+            writeBinaryString(out, group.first);
+            writeBinary<uint32_t>(out, userGraph.nodes[group.second]->ownerId);
+        }
+        uint64_t memberships = 0, shares = 0;
+        for (const auto& node : userGraph.nodes) {
+            memberships += node.second->members.size();
+            shares += node.second->outboundCount;
+        }
+        writeBinary<uint64_t>(out, memberships);
+        for (const auto& node : userGraph.nodes) {
+            for (uint32_t member : node.second->members) {
+                writeBinary<uint32_t>(out, node.first);
+                writeBinary<uint32_t>(out, member);
+            }
+        }
+        writeBinary<uint64_t>(out, shares);
+        for (const auto& node : userGraph.nodes) {
+            for (const auto& object : node.second->outbound) {
+                for (const auto& share : object.second) {
+                    ShareEdge* edge = share.second;
+                    writeBinary<uint32_t>(out, edge->ownerId);
+                    writeBinary<uint32_t>(out, edge->receiverId);
+                    writeBinary<uint64_t>(out, edge->objectKey);
+                    writeBinaryString(out, edge->path);
+                    writeBinary<PermissionMask>(out, edge->permissions);
+                }
+            }
+        }
+
+        // Recycle bin, oldest entry first, each with its version count and the length of its file record
+        bin.save(out, relocated);
+    }
+
+    // Read what writeTail wrote into a freshly constructed file system; false if it is damaged.
+    // Images written before credentials were hashed hold the plaintext, which is hashed here.
+    // Recycle bin entries stay records in the image if `sizedBin`, or are loaded otherwise.
+    bool readTail(istream& in, bool plaintextCredentials, ContentRefs refs, bool sizedBin)
+    {
+        uint64_t count;
+        if (!readBinary(in, count)) return false;
+        for (uint64_t i = 0; i < count; i++) {
+            uint32_t id;
+            uint8_t role;
+            string username, salt, passwordHash, answerHash;
+            Timestamp lastLogout;
+            if (!readBinary(in, id) || !readBinaryString(in, username) ||
+                (!plaintextCredentials && !readBinaryString(in, salt)) || !readBinaryString(in, passwordHash) ||
+                !readBinary(in, role) || !readBinaryString(in, answerHash) || !readBinary(in, lastLogout)) {
+                return false;
+            }
+            if (plaintextCredentials) {
+                plaintextRecovered = true;
+                salt = newSalt();
+                passwordHash = hashCredential(salt, passwordHash);
+                answerHash = hashCredential(salt, answerHash);
+            }
+            auth.restoreAccount(id, username, salt, passwordHash, static_cast<Role>(role), answerHash, lastLogout);
+            userGraph.addUser(id, username);
+        }
+
+        if (!readBinary(in, count)) return false;
+        for (uint64_t i = 0; i < count; i++) {
+            uint32_t id, ownerId;
+            string name;
+            if (!readBinary(in, id) || !readBinaryString(in, name) || !readBinary(in, ownerId)) return false;
+            userGraph.restoreGroup(id, name, ownerId);
+        }
+        if (!readBinary(in, count)) return false;
+        for (uint64_t i = 0; i < count; i++) {
+            uint32_t groupId, memberId;
+            if (!readBinary(in, groupId) || !readBinary(in, memberId)) return false;
+            UserGraphNode* group = userGraph.findUserNode(groupId);
+            UserGraphNode* member = userGraph.findUserNode(memberId);
+            if (!group || !member) return false;
+            group->members.insert(memberId);
+            member->memberOf.insert(groupId);
+        }
+        if (!readBinary(in, count)) return false;
+        for (uint64_t i = 0; i < count; i++) {
+            uint32_t ownerId, receiverId;
+            uint64_t key;
+            string sharedPath;
+            PermissionMask permissions;
+            if (!readBinary(in, ownerId) || !readBinary(in, receiverId) || !readBinary(in, key) ||
+                !readBinaryString(in, sharedPath) || !readBinary(in, permissions)) {
+                return false;
+            }
+            UserGraphNode* ownerNode = userGraph.findUserNode(ownerId);
+            UserGraphNode* receiverNode = userGraph.findUserNode(receiverId);
+            if (!ownerNode || !receiverNode) return false;
+            userGraph.grant(ownerNode, receiverNode, key, sharedPath, permissions);
+        }
+
+        // Recycle bin entries only keep where their file record is
+        uint8_t more = 1;
+        while (readBinary(in, more) && more) {
+            string originalPath, name;
+            Timestamp deletionTime;
+            int32_t versionCount;
+            uint64_t recordBytes;
+            if (!readBinaryString(in, originalPath) || !readBinary(in, deletionTime)) return false;
+            if (!sizedBin) {
+                FileNode* file = loadFileNode(in, refs);
+                if (!file) return false;
+                clockOverride = deletionTime; // The entry keeps its original deletion time
+                bin.push(file, originalPath);
+                clockOverride = 0;
+                continue;
+            }
+            if (!readBinary(in, versionCount) || !readBinary(in, recordBytes)) return false;
+            uint64_t offset = image->header().tailOffset + static_cast<uint64_t>(in.tellg());
+            MemoryBuffer record(image->at(offset), static_cast<size_t>(recordBytes));
+            istream recordIn(&record);
+            if (!in.seekg(static_cast<streamoff>(recordBytes), ios::cur) || !readBinaryString(recordIn, name)) return false;
+            bin.restore(symbols.intern(name), originalPath, deletionTime, versionCount, offset, recordBytes);
+        }
+        return static_cast<bool>(in) && more == 0;
+    }
+
+    // Write the whole file system as a namespace image (see ImageHeader).
+    // Folders and recycle bin entries that were never loaded are copied
+    // straight from the mapped image. `relocated` gets the new record index
+    // of each folder node that is not loaded yet and `relocatedEntries` the
+    // new offset of each such entry; apply them once the new image is mapped. `expiring`
+    // gets the content segments only the old image and the log may still
+    // use. Call with recycle bin purges held, so the chunk table matches the
+    // records written.
+    bool writeImage(const string& path, uint64_t lsn, vector<pair<FolderNode*, uint64_t>>& relocated,
+                    vector<pair<DeletedFile*, uint64_t>>& relocatedEntries, vector<uint32_t>& expiring)
+    {
+        if (image && image->inlineContent()) {
+            materializeSubtree(root); // Its records cannot be copied into an image that refers to chunks
+        }
+        vector<ImageChunk> chunkTable;
+        vector<ImageSegment> segmentTable;
+        ImageContentTables tables = {};
+        if (!blobStore.snapshot(chunkTable, segmentTable, tables.nextSegmentId, expiring)) {
+            return false;
+        }
+        ofstream out(path, ios::binary | ios::trunc);
+        if (!out) {
+            return false;
+        }
+        ImageHeader head = {};
+        memcpy(head.magic, IMAGE_MAGIC, sizeof(IMAGE_MAGIC));
+        head.lsn = lsn;
+        head.lastFileId = lastFileId;
+        head.lastFolderId = lastFolderId;
+        head.retention = bin.getRetention();
+        writeBinary(out, head); // Rewritten with the final counts and offsets at the end
+        writeBinary(out, tables);
+
+        // Names and file blocks in breadth-first order. A folder either is a
+        // loaded node, or a node not loaded yet, or exists only in the old
+        // image (node == nullptr); the last two are copied from the image.
+        struct Pending {
+            FolderNode* node;
+            uint64_t imageIndex;
+        };
+        vector<Pending> order{ { root, root->imageIndex } };
+        vector<ImageFolder> table;
+        for (size_t i = 0; i < order.size(); i++) {
+            FolderNode* node = order[i].node;
+            const ImageFolder* source = nullptr;
+            if (!node || !node->loaded) {
+                source = image ? image->folder(order[i].imageIndex) : nullptr;
+                if (!source) {
+                    return false;
+                }
+            }
+            ImageFolder record = {};
+            record.id = node ? node->id : source->id;
+            string name = node ? node->name : string(image->name(*source));
+            record.nameOffset = static_cast<uint64_t>(out.tellp());
+            record.nameLength = static_cast<uint32_t>(name.length());
+            out.write(name.data(), name.length());
+            record.firstChild = order.size();
+            record.filesOffset = static_cast<uint64_t>(out.tellp());
+            if (source) {
+                out.write(image->at(source->filesOffset), source->filesBytes);
+                record.fileCount = source->fileCount;
+                for (uint32_t k = 0; k < source->childCount; k++) {
+                    order.push_back({ nullptr, source->firstChild + k });
+                }
+                if (node) {
+                    relocated.emplace_back(node, i);
+                }
+            } else {
+                for (FileNode* file = node->files; file; file = file->next) {
+                    saveFileNode(out, file);
+                    record.fileCount++;
+                }
+                for (FolderNode* sub = node->child; sub; sub = sub->sibling) {
+                    order.push_back({ sub, sub->imageIndex });
+                }
+            }
+            record.filesBytes = static_cast<uint64_t>(out.tellp()) - record.filesOffset;
+            record.childCount = static_cast<uint32_t>(order.size() - record.firstChild);
+            head.fileCount += record.fileCount;
+            table.push_back(record);
+        }
+
+        while (out.tellp() % alignof(ImageFolder) != 0) {
+            out.put(0); // The folder table is read in place, so keep it aligned
+        }
+        head.folderCount = table.size();
+        head.folderTableOffset = static_cast<uint64_t>(out.tellp());
+        out.write(reinterpret_cast<const char*>(table.data()), table.size() * sizeof(ImageFolder));
+        head.tailOffset = static_cast<uint64_t>(out.tellp());
+        writeTail(out, relocatedEntries);
+        head.tailBytes = static_cast<uint64_t>(out.tellp()) - head.tailOffset;
+
+        while (out.tellp() % alignof(ImageChunk) != 0) {
+            out.put(0);
+        }
+        tables.chunkTableOffset = static_cast<uint64_t>(out.tellp());
+        tables.chunkCount = chunkTable.size();
+        out.write(reinterpret_cast<const char*>(chunkTable.data()), chunkTable.size() * sizeof(ImageChunk));
+        tables.segmentTableOffset = static_cast<uint64_t>(out.tellp());
+        tables.segmentCount = segmentTable.size();
+        out.write(reinterpret_cast<const char*>(segmentTable.data()), segmentTable.size() * sizeof(ImageSegment));
+        out.seekp(0);
+        writeBinary(out, head);
+        writeBinary(out, tables);
+        out.close();
+        return !out.fail();
+    }
+
+    // Map a namespace image into a freshly constructed file system. Only the
+    // counters, accounts, groups, shares and recycle bin are read now; each
+    // folder is loaded from the image the first time it is used. False if
+    // the image is damaged.
+    bool loadImage(const string& path, uint64_t& lsn)
+    {
+        MappedImage* mapped = new MappedImage();
+        const ImageFolder* top = mapped->open(path) ? mapped->folder(0) : nullptr;
+        if (!top) {
+            delete mapped;
+            return false;
+        }
+        image = mapped;
+        const ImageHeader& head = image->header();
+        lsn = head.lsn;
+        lastFileId = head.lastFileId;
+        lastFolderId = head.lastFolderId;
+        bin.setRetention(head.retention);
+        root->id = top->id;
+        root->imageIndex = 0;
+        root->loaded = false;
+        MemoryBuffer tail(image->at(head.tailOffset), head.tailBytes);
+        istream in(&tail);
+        bin.useImage(image, {});
+        if (!image->inlineContent()) {
+            blobStore.attachImage(image->chunkTable(), image->chunkCount(), image->segmentTable(), image->segmentCount(),
+                                  image->contentTables().nextSegmentId);
+        }
+        return readTail(in, image->plaintextCredentials(), image->contentRefs(), image->sizedBinRecords());
+    }
+
+    // Load one folder from the mapped image: its subfolders become nodes that
+    // are not loaded yet, and its files are added to the tree and indexes
+    void materialize(FolderNode* folder)
+    {
+        folder->loaded = true;
+        const ImageFolder* record = image ? image->folder(folder->imageIndex) : nullptr;
+        if (!record) {
+            cout << RED << "Folder '" << getFolderPath(folder) << "' is damaged in the image and was left empty." << RESET << endl;
+            return;
+        }
+        streambuf* console = cout.rdbuf(nullptr); // Loading is not a change the user made
+        for (uint32_t k = 0; k < record->childCount; k++) {
+            const ImageFolder* childRecord = image->folder(record->firstChild + k);
+            if (!childRecord) {
+                continue;
+            }
+            FolderNode* child = folderPool.create(string(image->name(*childRecord)), folder, nullptr, nullptr, nullptr);
+            child->id = childRecord->id;
+            child->imageIndex = record->firstChild + k;
+            child->loaded = false;
+            folder->addChild(child);
+        }
+        MemoryBuffer files(image->at(record->filesOffset), record->filesBytes);
+        istream in(&files);
+        string folderPath = getFolderPath(folder);
+        for (uint64_t j = 0; j < record->fileCount; j++) {
+            FileNode* file = loadFileNode(in, image->contentRefs());
+            if (!file) {
+                break;
+            }
+            folder->addFile(file);
+            fileHeap.insert(file);
+            metadata.insert(folderPath + "/" + symbols.str(file->name), file->type, static_cast<int>(file->versions.latestContent.size()),
+                            file->owner, file->created, file->modified);
+        }
+        cout.rdbuf(console);
+        cout.clear();
+    }
+
+    // Give up the chunk references of every file below a folder that is
+    // still only in the image, reading the records without loading them
+    void releaseUnloadedFiles(FolderNode* folder)
+    {
+        if (!image || image->inlineContent()) {
+            return; // Inline records hold no references
+        }
+        vector<uint64_t> records;
+        vector<FolderNode*> pending{ folder };
+        while (!pending.empty()) {
+            FolderNode* curr = pending.back();
+            pending.pop_back();
+            if (!curr->loaded) {
+                records.push_back(curr->imageIndex); // Its subfolders are not nodes yet either
+            }
+            for (FolderNode* sub = curr->child; sub; sub = sub->sibling) {
+                pending.push_back(sub);
+            }
+        }
+        while (!records.empty()) {
+            const ImageFolder* record = image->folder(records.back());
+            records.pop_back();
+            if (!record) {
+                continue;
+            }
+            for (uint32_t k = 0; k < record->childCount; k++) {
+                records.push_back(record->firstChild + k);
+            }
+            MemoryBuffer files(image->at(record->filesOffset), record->filesBytes);
+            istream in(&files);
+            for (uint64_t j = 0; j < record->fileCount; j++) {
+                if (!releaseFileRecord(in, ContentRefs::Counted)) {
+                    break;
+                }
+            }
+        }
+    }
+
+    // Visit every file below a folder that is still only in the image, as
+    // (full path, record summary, share keys of its folders, nearest first),
+    // reading the records in place. Images with inline content cannot be
+    // summarized, so such a subtree is loaded instead and then not visited.
+    template <typename Visit>
+    void forEachUnloadedFile(FolderNode* folder, Visit visit)
+    {
+        if (!image) {
+            return;
+        }
+        if (image->inlineContent()) {
+            materializeSubtree(folder);
+            return;
+        }
+        struct Pending {
+            uint64_t imageIndex;
+            string path;
+            vector<uint64_t> keys;
+        };
+        vector<Pending> records;
+        vector<FolderNode*> pending{ folder };
+        while (!pending.empty()) {
+            FolderNode* curr = pending.back();
+            pending.pop_back();
+            if (!curr->loaded) {
+                vector<uint64_t> keys;
+                for (FolderNode* above = curr; above; above = above->parent) {
+                    keys.push_back(above->id | FOLDER_KEY_FLAG);
+                }
+                records.push_back({ curr->imageIndex, getFolderPath(curr), move(keys) }); // Its subfolders are not nodes yet either
+                continue;
+            }
+            for (FolderNode* sub = curr->child; sub; sub = sub->sibling) {
+                pending.push_back(sub);
+            }
+        }
+        FileRecordSummary summary;
+        while (!records.empty()) {
+            Pending entry = move(records.back());
+            records.pop_back();
+            const ImageFolder* record = image->folder(entry.imageIndex);
+            if (!record) {
+                continue;
+            }
+            for (uint32_t k = 0; k < record->childCount; k++) {
+                const ImageFolder* childRecord = image->folder(record->firstChild + k);
+                if (!childRecord) {
+                    continue;
+                }
+                vector<uint64_t> keys{ childRecord->id | FOLDER_KEY_FLAG };
+                keys.insert(keys.end(), entry.keys.begin(), entry.keys.end());
+                records.push_back({ record->firstChild + k, entry.path + "/" + string(image->name(*childRecord)), move(keys) });
+            }
+            MemoryBuffer files(image->at(record->filesOffset), record->filesBytes);
+            istream in(&files);
+            for (uint64_t j = 0; j < record->fileCount; j++) {
+                if (!readFileSummary(in, summary)) {
+                    break;
+                }
+                visit(entry.path + "/" + summary.name, summary, entry.keys);
+            }
+        }
+    }
+
+    // Load every folder below (and including) a folder that is still only in the image
+    void materializeSubtree(FolderNode* folder)
+    {
+        vector<FolderNode*> pending{ folder };
+        while (!pending.empty()) {
+            FolderNode* curr = pending.back();
+            pending.pop_back();
+            curr->ensureLoaded();
+            for (FolderNode* sub = curr->child; sub; sub = sub->sibling) {
+                pending.push_back(sub);
+            }
+        }
+    }
+
+    // Apply one logged change again, as the user who made it and at the time
+    // it was made. False if the change failed, i.e. the replayed state has
+    // diverged from the state the change was logged against.
+    bool applyRecord(const JournalRecord& record)
+    {
+        auto arg = [&](size_t i) { return i < record.args.size() ? record.args[i] : string(); };
+        if (record.op != JournalOp::Signup && record.op != JournalOp::ResetPassword) {
+            UserNode* actor = auth.find(record.actor);
+            if (!actor) {
+                return false;
+            }
+            actAs(actor);
+        }
+        clockOverride = record.time;
+        bool applied = false;
+        Blob logged; // Content of a record that refers to chunks
+        switch (record.op) {
+        case JournalOp::Signup:
+            if (record.args.size() == 4) {
+                applied = signup(arg(0), arg(1), arg(2), arg(3)); // Logged before credentials were hashed
+                plaintextRecovered = true;
+            } else {
+                applied = restoreSignup(arg(0), arg(1), arg(2), arg(3), arg(4));
+            }
+            break;
+        case JournalOp::CreateFolder: applied = createFolder(arg(0)); break;
+        case JournalOp::CreateFile: applied = createFile(arg(0), arg(1), arg(2), static_cast<int>(record.number)); break;
+        case JournalOp::UpdateFile: applied = updateFile(arg(0), arg(1)); break;
+        case JournalOp::RollbackFile: applied = rollbackFile(arg(0)); break;
+        case JournalOp::RollbackFileToVersion: applied = rollbackFileToVersion(arg(0), static_cast<int>(record.number)); break;
+        case JournalOp::DeleteFile: applied = deleteFile(arg(0)); break;
+        case JournalOp::RestoreFile: applied = restoreFile(arg(0)); break;
+        case JournalOp::DeleteFolder: applied = deleteFolder(arg(0), false); break;
+        case JournalOp::RenameFolder: applied = renameFolder(arg(0), arg(1)); break;
+        case JournalOp::MoveFolder: applied = moveFolder(arg(0), arg(1)); break;
+        case JournalOp::ShareFile: applied = shareFileWithUser(arg(0), arg(1), arg(2)); break;
+        case JournalOp::ShareFolder: applied = shareFolderWithUser(arg(0), arg(1), arg(2)); break;
+        case JournalOp::RevokeShare: applied = revokeShareFromUser(arg(0), arg(1)); break;
+        case JournalOp::CreateGroup: applied = createGroup(arg(0)); break;
+        case JournalOp::AddGroupMember: applied = changeGroupMembership(arg(0), arg(1), true); break;
+        case JournalOp::RemoveGroupMember: applied = changeGroupMembership(arg(0), arg(1), false); break;
+        case JournalOp::SetPriority: applied = setFilePriority(arg(0), static_cast<int>(record.number)); break;
+        case JournalOp::SetRetention: applied = setRetention(record.number); break;
+        case JournalOp::Logout: applied = logout(); break;
+        case JournalOp::ResetPassword: applied = restorePassword(arg(0), arg(1), arg(2), arg(3)); break;
+        case JournalOp::CreateFileChunks:
+            applied = Blob::fromReferences(arg(2), logged) && createFile(arg(0), arg(1), logged.str(), static_cast<int>(record.number));
+            break;
+        case JournalOp::UpdateFileChunks:
+            applied = Blob::fromReferences(arg(1), logged) && updateFile(arg(0), logged.str());
+            break;
+        }
+        clockOverride = 0;
+        return applied;
+    }
+
+    // Write an image of everything logged so far and start an empty log.
+    // The image replaces the old one atomically, so a crash at any point
+    // leaves either the old image with the full log or the new one.
+    bool checkpoint()
+    {
+        if (!wal) {
+            cout << RED << "Persistence is not enabled." << RESET << endl;
+            return false;
+        }
+        if (replayFailures > 0) {
+            cout << RED << "Checkpoint refused: " << replayFailures << " logged change(s) failed to replay at startup, "
+                 << "so the image and the write-ahead log are kept as they are." << RESET << endl;
+            return false;
+        }
+        auto started = chrono::steady_clock::now();
+        wal->sync();
+        uint64_t lsn = wal->lastSequence();
+        string temporary = imagePath + ".tmp";
+        vector<pair<FolderNode*, uint64_t>> relocated;
+        vector<pair<DeletedFile*, uint64_t>> relocatedEntries;
+        vector<uint32_t> expiring;
+        bin.holdPurges(true); // Until the chunk table of the new image is in use
+        if (!writeImage(temporary, lsn, relocated, relocatedEntries, expiring) || !syncToDisk(temporary)) {
+            bin.holdPurges(false);
+            remove(temporary.c_str());
+            cout << RED << "Checkpoint failed; the write-ahead log is kept." << RESET << endl;
+            return false;
+        }
+#ifdef _WIN32
+        if (image) {
+            blobStore.remapImage(nullptr, 0, false);
+            bin.useImage(nullptr, {});
+            image->close(); // A mapped file cannot be replaced on Windows
+        }
+#endif
+        bool replaced = replaceFile(temporary, imagePath);
+        MappedImage* mapped = new MappedImage();
+        if (!mapped->open(imagePath)) {
+            bin.holdPurges(false);
+            delete mapped;
+            cout << RED << "Checkpoint failed: cannot map '" << imagePath << "'." << RESET << endl;
+            return false;
+        }
+        blobStore.remapImage(mapped->chunkTable(), mapped->chunkCount(), replaced);
+        bin.useImage(mapped, replaced ? relocatedEntries : vector<pair<DeletedFile*, uint64_t>>());
+        bin.holdPurges(false);
+        delete image;
+        image = mapped;
+        if (replaced) {
+            for (const auto& folder : relocated) {
+                folder.first->imageIndex = folder.second;
+            }
+            if (!wal->truncate()) { // Records up to lsn are in the image; replay skips them if this does not happen
+                cout << RED << "Checkpoint written at LSN " << lsn << ", but the write-ahead log could not be emptied; "
+                     << "changes from now on may not be saved." << RESET << endl;
+                return false;
+            }
+            blobStore.expire(expiring);
+        } else {
+            remove(temporary.c_str());
+        }
+        sinceCheckpoint = 0;
+        long long elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - started).count();
+        cout << (replaced ? GREEN : RED) << "Checkpoint " << (replaced ? "written" : "could not replace the image") << " at LSN " << lsn
+             << " in " << elapsed << " ms." << RESET << endl;
+        return replaced;
+    }
+
+    // Recover from <prefix>.img and <prefix>.wal, then log every further
+    // change to <prefix>.wal. Call once, on a freshly constructed file system.
+    void openStorage(const string& prefix)
+    {
+        imagePath = prefix + ".img";
+        string logPath = prefix + ".wal";
+        auto started = chrono::steady_clock::now();
+        materializeFolder = [this](FolderNode* folder) { materialize(folder); };
+        blobStore.keepSegments(true); // The image and the log refer to the content segments
+
+        streambuf* console = cout.rdbuf(nullptr); // Recovery replays operations silently
+        replaying = true;
+        bin.holdPurges(true);
+        uint64_t lsn = 0;
+        bool haveImage = ifstream(imagePath, ios::binary).good();
+        bool loaded = !haveImage || loadImage(imagePath, lsn);
+        size_t replayed = 0;
+        bool torn = false;
+        if (loaded) {
+            WriteAheadLog::replay(logPath, [&](const JournalRecord& record) {
+                if (record.lsn > lsn) { // Older records are already in the image
+                    if (!applyRecord(record)) {
+                        replayFailures++;
+                    }
+                    lsn = record.lsn;
+                    replayed++;
+                }
+            }, torn);
+        }
+        actAs(nullptr);
+        current = root;
+        bin.holdPurges(false);
+        replaying = false;
+        cout.rdbuf(console);
+        cout.clear();
+
+        if (!loaded) {
+            cout << RED << "Image '" << imagePath << "' is damaged; running without persistence so it is not overwritten." << RESET << endl;
+            return; // Its segments are kept as well
+        }
+        wal = new WriteAheadLog(logPath, lsn);
+        if (!wal->isOpen()) {
+            cout << RED << "Cannot open write-ahead log '" << logPath << "'; changes will not be saved." << RESET << endl;
+            delete wal;
+            wal = nullptr;
+            return;
+        }
+        long long elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - started).count();
+        if (haveImage || replayed > 0) {
+            cout << GREEN << "Recovered in " << elapsed << " ms: ";
+            if (image) {
+                cout << image->header().folderCount << " folder(s) and " << image->header().fileCount << " file(s) mapped from the image (loaded on first use), ";
+            }
+            cout << replayed << " logged change(s) replayed." << RESET << endl;
+        }
+        if (replayFailures > 0) {
+            cout << RED << "WARNING: " << replayFailures << " logged change(s) could not be replayed. Checkpoints are disabled "
+                 << "for this run so '" << imagePath << "' and '" << logPath << "' stay intact." << RESET << endl;
+            if (torn) {
+                cout << RED << "The log also ends in an incomplete record, so changes cannot be appended to it; they will not be saved." << RESET << endl;
+                delete wal;
+                wal = nullptr;
+            }
+            return;
+        }
+        if (torn) {
+            cout << YELLOW << "Write-ahead log ended in an incomplete record; checkpointing to discard it." << RESET << endl;
+            checkpoint();
+        } else if (plaintextRecovered) {
+            cout << YELLOW << "Stored passwords were not hashed; checkpointing to replace them with hashes." << RESET << endl;
+            checkpoint();
+        } else if (image && image->inlineContent()) {
+            cout << YELLOW << "The image holds file content inline; checkpointing to keep it in content segments instead." << RESET << endl;
+            checkpoint();
+        }
+    }
+};
+
+// Main program loop
+int main()
+{
+    if (!sha256SelfTest()) {
+        cout << RED << "SHA-256 self-test failed; credentials cannot be hashed safely, so the program stops." << RESET << endl;
+        return 1;
+    }
+    FileSystem fs;
+    fs.openStorage("drive"); // Maps drive.img and replays drive.wal from the working directory
+    int choice;
+    string name;
+    string content;
+    string type;
+    string username;
+    string password;
+    string role;
+    string secAns;
+    string receiver;
+    string permission;
+    int priority;
+
+    while (true) {
+        cout << BOLD << MAGENTA << "--- Google Drive File System ---" << RESET << endl;
+        if (!fs.loggedInUser.empty()) {
+            cout << BOLD << CYAN << "Logged in as: " << fs.loggedInUser << " (" << roleName(fs.loggedInUserRole) << ")" << RESET << endl;
+            fs.printCurrentPath();
+        } else {
+            cout << YELLOW << "Please login or signup to use the file system." << RESET << endl;
+        }
+        cout << CYAN << "1. Signup" << RESET << endl;
+        cout << CYAN << "2. Login" << RESET << endl;
+        cout << CYAN << "3. Forgot Password" << RESET << endl;
+        cout << CYAN << "4. Create Folder" << RESET << endl;
+        cout << CYAN << "5. Create File" << RESET << endl;
+        cout << CYAN << "6. List Folders" << RESET << endl;
+        cout << CYAN << "7. List Files" << RESET << endl;
+        cout << CYAN << "8. Change Directory" << RESET << endl;
+        cout << CYAN << "9. Show Current Path" << RESET << endl;
+        cout << CYAN << "10. Read File" << RESET << endl;
+        cout << CYAN << "11. Update File (Add New Version)" << RESET << endl;
+        cout << CYAN << "12. Rollback File to Previous Version" << RESET << endl;
+        cout << CYAN << "13. Delete File (Move to Recycle Bin)" << RESET << endl;
+        cout << CYAN << "14. Delete Folder" << RESET << endl; // New option
+        cout << CYAN << "15. View File Metadata" << RESET << endl;
+        cout << CYAN << "16. View Last Deleted File (Recycle Bin Top)" << RESET << endl;
+        cout << CYAN << "17. Restore Deleted File (Recycle Bin)" << RESET << endl; // New option
+        cout << CYAN << "18. Display All Recycle Bin Contents" << RESET << endl; // New option
+        cout << CYAN << "19. Recent Files (LRU)" << RESET << endl;
+        cout << CYAN << "20. Share File" << RESET << endl;
+        cout << CYAN << "21. View Files Shared By Me" << RESET << endl;
+        cout << CYAN << "22. View Files Shared With Me" << RESET << endl; // New option
+        cout << CYAN << "23. Display Files by Priority" << RESET << endl;
+        cout << CYAN << "24. Logout" << RESET << endl;
+        cout << CYAN << "25. Read Specific File Version" << RESET << endl;
+        cout << CYAN << "26. Rollback File to Specific Version" << RESET << endl;
+        cout << CYAN << "27. Storage Statistics (Deduplication, Metadata Table, Content Cache)" << RESET << endl;
+        cout << CYAN << "28. Rename Folder" << RESET << endl;
+        cout << CYAN << "29. Move Folder" << RESET << endl;
+        cout << CYAN << "30. Query File Metadata" << RESET << endl;
+        cout << CYAN << "31. Storage Report (Aggregates)" << RESET << endl;
+        cout << CYAN << "32. Set Recycle Bin Retention" << RESET << endl;
+        cout << CYAN << "33. Set Recycle Bin Memory Budget" << RESET << endl;
+        cout << CYAN << "34. Set Recent Files Capacity" << RESET << endl;
+        cout << CYAN << "35. Revoke File or Folder Share" << RESET << endl;
+        cout << CYAN << "36. Create Group" << RESET << endl;
+        cout << CYAN << "37. Add Member to Group" << RESET << endl;
+        cout << CYAN << "38. Remove Member from Group" << RESET << endl;
+        cout << CYAN << "39. Share Folder" << RESET << endl;
+        cout << CYAN << "40. Change File Priority" << RESET << endl;
+        cout << CYAN << "41. Top Files by Priority" << RESET << endl;
+        cout << CYAN << "42. Checkpoint (Write Image Now)" << RESET << endl;
+        cout << CYAN << "43. Set Content Cache Budget" << RESET << endl;
+        cout << CYAN << "0. Exit" << RESET << endl;
+
+        while (true) {
+            cout << GREEN << "Enter choice: " << RESET;
+            if (cin >> choice) {
+                cin.ignore(numeric_limits<streamsize>::max(), '\n'); // Clear buffer
+                break;
+            }
+            else {
+                cout << RED << "Invalid input. Please enter a number." << RESET << endl;
+                cin.clear(); // Clear error flags
+                cin.ignore(numeric_limits<streamsize>::max(), '\n'); // Discard invalid input
+            }
+        }
+
+        if (choice == 1) // Signup
+        {
+            cout << "Enter Username: ";
+            getline(cin, username);
+            cout << "Enter Password: ";
+            getline(cin, password);
+            while (true) {
+                cout << "Enter your role (admin, editor, viewer): ";
+                getline(cin, role);
+                if (parseRole(role) != Role::None) {
+                    break;
+                }
+                else {
+                    cout << RED << "Invalid role. Please enter admin, editor, or viewer." << RESET << endl;
+                }
+            }
+            cout << "Enter your recovery code (e.g., your favorite color): ";
+            getline(cin, secAns);
+            fs.signup(username, password, role, secAns);
+            pauseAndClear();
+        }
+        else if (choice == 2) // Login
+        {
+            cout << "Enter Username: ";
+            getline(cin, username);
+            cout << "Enter Password: ";
+            getline(cin, password);
+            UserNode* user = fs.auth.login(username, password);
+            if (user)
+            {
+                fs.beginSession(user); // Role comes with the account; fresh recent files list
+                cout << GREEN << "Welcome, " << username << " (" << roleName(fs.loggedInUserRole) << ")!" << RESET << endl;
+            }
+            pauseAndClear();
+        }
+        else if (choice == 3) // Forgot Password
+        {
+            cout << "Enter Username: ";
+            getline(cin, username);
+            cout << "Enter Security Answer: ";
+            getline(cin, secAns);
+            if (fs.auth.forgot(username, secAns)) {
+                cout << "Enter New Password: ";
+                getline(cin, password);
+                fs.resetPassword(username, password, secAns);
+            }
+            pauseAndClear();
+        }
+        else if (choice == 0) // Exit
+        {
+            cout << "Exiting Google Drive File System. Goodbye!" << endl;
+            break;
+        }
+        // Rest of the functionalities require login
+        else if (fs.loggedInUser.empty())
+        {
+            cout << RED << "Permission denied. Please login first to perform this action." << RESET << endl;
+            pauseAndClear();
+        }
+        else if (choice == 4) // Create Folder
+        {
+            cout << "Enter Folder name (or path): ";
+            getline(cin, name);
+            fs.createFolder(name);
+            pauseAndClear();
+        }
+        else if (choice == 5) // Create File
+        {
+            cout << "Enter File name (or path): ";
+            getline(cin, name);
+            cout << "Enter File type (e.g., .txt, .pdf): ";
+            getline(cin, type);
+            cout << "Enter File content: ";
+            getline(cin, content);
+            cout << "Enter File priority (0-100, higher for more important): ";
+            // Input validation for priority
+            while (!(cin >> priority) || priority < 0 || priority > 100) {
+                cout << RED << "Invalid priority. Please enter a number between 0 and 100: " << RESET;
+                cin.clear();
+                cin.ignore(numeric_limits<streamsize>::max(), '\n');
+            }
+            cin.ignore(numeric_limits<streamsize>::max(), '\n'); // Clear buffer after numeric input
+            fs.createFile(name, type, content, priority);
+            pauseAndClear();
+        }
+        else if (choice == 6) // List Folders
+        {
+            fs.listFolders();
+            pauseAndClear();
+        }
+        else if (choice == 7) // List Files
+        {
+            fs.listFiles();
+            pauseAndClear();
+        }
+        else if (choice == 8) // Change Directory
+        {
+            cout << "Enter Folder name or path to change to (or '..' to go back, 'root' to go to root): ";
+            getline(cin, name);
+            fs.changeDirectory(name);
+            pauseAndClear();
+        }
+        else if (choice == 9) // Show Current Path
+        {
+            fs.printCurrentPath();
+            pauseAndClear();
+        }
+        else if (choice == 10) // Read File
+        {
+            cout << "Enter File name or path to read: ";
+            getline(cin, name);
+            fs.readFile(name);
+            pauseAndClear();
+        }
+        else if (choice == 11) // Update File (Add New Version)
+        {
+            cout << "Enter File name or path to update: ";
+            getline(cin, name);
+            cout << "Enter New content: ";
+            getline(cin, content);
+            fs.updateFile(name, content);
+            pauseAndClear();
+        }
+        else if (choice == 12) // Rollback File
+        {
+            cout << "Enter File name or path to rollback: ";
+            getline(cin, name);
+            fs.rollbackFile(name);
+            pauseAndClear();
+        }
+        else if (choice == 13) // Delete File (Move to Recycle Bin)
+        {
+            cout << "Enter File name or path to delete: ";
+            getline(cin, name);
+            fs.deleteFile(name);
+            pauseAndClear();
+        }
+        else if (choice == 14) // Delete Folder (New)
+        {
+            cout << "Enter Folder name or path to delete: ";
+            getline(cin, name);
+            fs.deleteFolder(name);
+            pauseAndClear();
+        }
+        else if (choice == 15) // View Metadata
+        {
+            cout << "Enter File name to view metadata: ";
+            getline(cin, name);
+            fs.viewMetadata(name);
+            pauseAndClear();
+        }
+        else if (choice == 16) // View Last Deleted File (Recycle Bin Top)
+        {
+            fs.bin.viewTop();
+            pauseAndClear();
+        }
+        else if (choice == 17) // Restore Deleted File (Recycle Bin)
+        {
+            cout << "Enter File name or original path to restore (leave empty for the last deleted file): ";
+            getline(cin, name);
+            fs.restoreFile(name);
+            pauseAndClear();
+        }
+        else if (choice == 18) // Display All Recycle Bin Contents (New)
+        {
+            fs.bin.displayAll();
+            pauseAndClear();
+        }
+        else if (choice == 19) // Recent Files (LRU)
+        {
+            fs.recent->display();
+            pauseAndClear();
+        }
+        else if (choice == 20) // Share File
+        {
+            cout << "Enter Receiver Username (or @group): ";
+            getline(cin, receiver);
+            cout << "Enter File name or path to share: ";
+            getline(cin, name);
+            cout << "Enter Permission (read/write/execute): ";
+            getline(cin, permission);
+            fs.shareFileWithUser(receiver, name, permission);
+            pauseAndClear();
+        }
+        else if (choice == 21) // View Files Shared By Me
+        {
+            fs.displaySharedFilesByMe();
+            pauseAndClear();
+        }
+        else if (choice == 22) // View Files Shared With Me (New)
+        {
+            fs.displayFilesSharedWithMe();
+            pauseAndClear();
+        }
+        else if (choice == 23) // Display Files by Priority
+        {
+            fs.displayFilesByPriority();
+            pauseAndClear();
+        }
+        else if (choice == 24) // Logout
+        {
+            fs.endSession(); // Record logout time, clear role and recent files
+            cout << GREEN << "You have been logged out." << RESET << endl;
+            pauseAndClear();
+        }
+        else if (choice == 25 || choice == 26) // Read / Rollback Specific Version
+        {
+            cout << "Enter File name or path: ";
+            getline(cin, name);
+            cout << "Enter Version number: ";
+            int versionNumber;
+            while (!(cin >> versionNumber)) {
+                cout << RED << "Invalid version. Please enter a number: " << RESET;
+                cin.clear();
+                cin.ignore(numeric_limits<streamsize>::max(), '\n');
+            }
+            cin.ignore(numeric_limits<streamsize>::max(), '\n'); // Clear buffer after numeric input
+            if (choice == 25) {
+                fs.readFileVersion(name, versionNumber);
+            } else {
+                fs.rollbackFileToVersion(name, versionNumber);
+            }
+            pauseAndClear();
+        }
+        else if (choice == 27) // Storage Statistics
+        {
+            fs.displayStorageStats();
+            pauseAndClear();
+        }
+        else if (choice == 28) // Rename Folder
+        {
+            cout << "Enter Folder name or path to rename: ";
+            getline(cin, name);
+            cout << "Enter New folder name: ";
+            string newName;
+            getline(cin, newName);
+            fs.renameFolder(name, newName);
+            pauseAndClear();
+        }
+        else if (choice == 29) // Move Folder
+        {
+            cout << "Enter Folder name or path to move: ";
+            getline(cin, name);
+            cout << "Enter Destination folder path: ";
+            string destination;
+            getline(cin, destination);
+            fs.moveFolder(name, destination);
+            pauseAndClear();
+        }
+        else if (choice == 30) // Query File Metadata
+        {
+            cout << "Enter Query (e.g., owner=admin AND type=.pdf AND size>1MB): ";
+            string expression;
+            getline(cin, expression);
+            fs.queryMetadata(expression);
+            pauseAndClear();
+        }
+        else if (choice == 31) // Storage Report
+        {
+            fs.displayStorageReport();
+            pauseAndClear();
+        }
+        else if (choice == 32) // Set Recycle Bin Retention
+        {
+            if (fs.loggedInUserRole != Role::Admin) {
+                cout << RED << "Permission denied. Only admins can change the retention window." << RESET << endl;
+            } else {
+                cout << "Current retention: " << fs.bin.getRetention() / (60 * 60) << " hour(s)." << endl;
+                cout << "Enter new retention in hours: ";
+                long long hours;
+                while (!(cin >> hours) || hours < 0) {
+                    cout << RED << "Invalid value. Please enter a non-negative number of hours: " << RESET;
+                    cin.clear();
+                    cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                }
+                cin.ignore(numeric_limits<streamsize>::max(), '\n'); // Clear buffer after numeric input
+                fs.setRetention(hours * 60 * 60);
+            }
+            pauseAndClear();
+        }
+        else if (choice == 33) // Set Recycle Bin Memory Budget
+        {
+            if (fs.loggedInUserRole != Role::Admin) {
+                cout << RED << "Permission denied. Only admins can change the memory budget." << RESET << endl;
+            } else {
+                cout << "Current budget: " << fs.bin.getMemoryBudget() / (1024 * 1024) << " MB." << endl;
+                cout << "Enter new budget in MB (older deleted files beyond it are kept on disk): ";
+                long long megabytes;
+                while (!(cin >> megabytes) || megabytes < 0) {
+                    cout << RED << "Invalid value. Please enter a non-negative number of megabytes: " << RESET;
+                    cin.clear();
+                    cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                }
+                cin.ignore(numeric_limits<streamsize>::max(), '\n'); // Clear buffer after numeric input
+                fs.bin.setMemoryBudget(static_cast<size_t>(megabytes) * 1024 * 1024);
+            }
+            pauseAndClear();
+        }
+        else if (choice == 34) // Set Recent Files Capacity
+        {
+            cout << "Current capacity: " << fs.recentCapacity << " file(s)." << endl;
+            cout << "Enter new capacity: ";
+            int capacity;
+            while (!(cin >> capacity) || capacity < 0) {
+                cout << RED << "Invalid value. Please enter a non-negative number of files: " << RESET;
+                cin.clear();
+                cin.ignore(numeric_limits<streamsize>::max(), '\n');
+            }
+            cin.ignore(numeric_limits<streamsize>::max(), '\n'); // Clear buffer after numeric input
+            fs.setRecentCapacity(capacity);
+            pauseAndClear();
+        }
+        else if (choice == 35) // Revoke File or Folder Share
+        {
+            cout << "Enter Receiver Username (or @group): ";
+            getline(cin, receiver);
+            cout << "Enter File or folder name or path: ";
+            getline(cin, name);
+            fs.revokeShareFromUser(receiver, name);
+            pauseAndClear();
+        }
+        else if (choice == 36) // Create Group
+        {
+            cout << "Enter Group name: ";
+            getline(cin, name);
+            fs.createGroup(name);
+            pauseAndClear();
+        }
+        else if (choice == 37 || choice == 38) // Add / Remove Group Member
+        {
+            cout << "Enter Group name: ";
+            getline(cin, name);
+            cout << "Enter Member Username (or @group): ";
+            getline(cin, receiver);
+            fs.changeGroupMembership(name, receiver, choice == 37);
+            pauseAndClear();
+        }
+        else if (choice == 39) // Share Folder
+        {
+            cout << "Enter Receiver Username (or @group): ";
+            getline(cin, receiver);
+            cout << "Enter Folder name or path to share: ";
+            getline(cin, name);
+            cout << "Enter Permission (read/write/execute): ";
+            getline(cin, permission);
+            fs.shareFolderWithUser(receiver, name, permission);
+            pauseAndClear();
+        }
+        else if (choice == 40) // Change File Priority
+        {
+            cout << "Enter File name or path: ";
+            getline(cin, name);
+            cout << "Enter new priority (0-100, higher for more important): ";
+            while (!(cin >> priority) || priority < 0 || priority > 100) {
+                cout << RED << "Invalid priority. Please enter a number between 0 and 100: " << RESET;
+                cin.clear();
+                cin.ignore(numeric_limits<streamsize>::max(), '\n');
+            }
+            cin.ignore(numeric_limits<streamsize>::max(), '\n'); // Clear buffer after numeric input
+            fs.setFilePriority(name, priority);
+            pauseAndClear();
+        }
+        else if (choice == 41) // Top Files by Priority
+        {
+            cout << "How many files: ";
+            int count;
+            while (!(cin >> count) || count <= 0) {
+                cout << RED << "Invalid value. Please enter a positive number of files: " << RESET;
+                cin.clear();
+                cin.ignore(numeric_limits<streamsize>::max(), '\n');
+            }
+            cin.ignore(numeric_limits<streamsize>::max(), '\n'); // Clear buffer after numeric input
+            cout << "Enter Folder name or path (leave empty for all folders): ";
+            getline(cin, name);
+            cout << "Enter Owner username (leave empty for any owner): ";
+            getline(cin, receiver);
+            fs.displayTopFiles(count, name, receiver);
+            pauseAndClear();
+        }
+        else if (choice == 42) // Checkpoint
+        {
+            if (fs.loggedInUserRole != Role::Admin) {
+                cout << RED << "Permission denied. Only admins can write a checkpoint." << RESET << endl;
+            } else {
+                fs.checkpoint();
+            }
+            pauseAndClear();
+        }
+        else if (choice == 43) // Set Content Cache Budget
+        {
+            if (fs.loggedInUserRole != Role::Admin) {
+                cout << RED << "Permission denied. Only admins can change the content cache budget." << RESET << endl;
+            } else {
+                cout << "Current budget: " << fs.contentCache.getBudget() / (1024 * 1024) << " MB." << endl;
+                cout << "Enter new budget in MB (0 turns the cache off): ";
+                long long megabytes;
+                while (!(cin >> megabytes) || megabytes < 0) {
+                    cout << RED << "Invalid value. Please enter a non-negative number of megabytes: " << RESET;
+                    cin.clear();
+                    cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                }
+                cin.ignore(numeric_limits<streamsize>::max(), '\n'); // Clear buffer after numeric input
+                fs.contentCache.setBudget(static_cast<size_t>(megabytes) * 1024 * 1024);
+            }
+            pauseAndClear();
+        }
+        else {
+            cout << RED << "Invalid choice. Please enter a valid option." << RESET << endl;
+            pauseAndClear();
+        }
+    }
+    // system("pause"); // This is Windows specific, might not work on other OS
+    return 0;
+}